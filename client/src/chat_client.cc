@@ -0,0 +1,1170 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// This is a derivative work, original copyright below:
+// Copyright (c) 2003-2018 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+
+#include "chat_client.hh"
+
+using Json = nlohmann::json;
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <tuple>
+#include <utility>
+
+// writes are already gathered into one, nagle would only hold a message
+// typed while the last one is unacked back until the server's delayed ack
+static void no_delay(boost::asio::ip::tcp::socket& socket)
+{
+  boost::system::error_code ignored;
+  socket.set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+}
+
+// the other transports have no nagle to turn off
+template<typename Socket>
+static void no_delay(Socket&)
+{
+}
+
+template<typename Protocol>
+chat_basic_client<Protocol>::chat_basic_client(boost::asio::io_context& io_context) :
+  strand_ {io_context.get_executor()},
+  socket_ {io_context},
+  timer_ {io_context},
+  ping_timer_ {io_context},
+  rng_ {std::random_device{}()}
+{
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::connect(endpoints_type const& endpoints)
+{
+  boost::asio::dispatch(strand_,
+    [this, endpoints]()
+    {
+      endpoints_ = endpoints;
+      do_connect();
+    }
+  );
+}
+
+template<typename Protocol>
+bool chat_basic_client<Protocol>::login(std::string const& user, std::string const& pass)
+{
+  chat_auth req;
+  req.user = user;
+  req.pass = pass;
+  req.since = std::numeric_limits<std::uint64_t>::max();
+  req.acks = 1;
+
+  // leave room for the fields added on the strand
+  if (chat_length(req) > chat_message::max_body_length)
+  {
+    return false;
+  }
+
+  boost::asio::dispatch(strand_,
+    [this, user, pass]()
+    {
+      user_ = user;
+      pass_ = pass;
+      login_pending_ = true;
+      do_queue(auth_request(), 0, clock::now());
+    }
+  );
+
+  return true;
+}
+
+template<typename Protocol>
+bool chat_basic_client<Protocol>::watch(std::string const& token, bool lossy)
+{
+  chat_watch req;
+  req.token = token;
+  req.since = std::numeric_limits<std::uint64_t>::max();
+  req.lossy = 1;
+
+  if (chat_length(req) > chat_message::max_body_length)
+  {
+    return false;
+  }
+
+  boost::asio::dispatch(strand_,
+    [this, token, lossy]()
+    {
+      token_ = token;
+      lossy_ = lossy;
+      login_pending_ = true;
+      do_queue(auth_request(), 0, clock::now());
+    }
+  );
+
+  return true;
+}
+
+template<typename Protocol>
+std::uint64_t chat_basic_client<Protocol>::msg(std::string const& text)
+{
+  // the server could not parse it, so it never gets an id to wait on
+  if (! chat_utf8_valid(text.data(), text.size()))
+  {
+    return 0;
+  }
+
+  auto const sent = clock::now();
+
+  chat_msg req;
+  req.msg = text;
+  req.id = std::numeric_limits<std::uint64_t>::max();
+
+  if (chat_length(req) + stamp_length <= chat_message::max_body_length)
+  {
+    auto const id = next_id_.fetch_add(1);
+    req.id = id;
+    return queue(chat_dump(req), id) ? id : 0;
+  }
+
+  // too long for one frame, split the text into chunks that carry their
+  // part number and the number of parts, with consecutive ids so the
+  // receiver can reassemble them
+  req.msg = " ";
+  req.part = std::numeric_limits<std::uint32_t>::max();
+  req.parts = std::numeric_limits<std::uint32_t>::max();
+  auto const budget = chat_message::max_body_length - stamp_length - (chat_length(req) - 1);
+
+  auto const chunks = split(text, budget);
+  auto const first = next_id_.fetch_add(chunks.size());
+
+  std::vector<std::string> reqs;
+  reqs.reserve(chunks.size());
+  for (std::size_t i = 0; i < chunks.size(); ++i)
+  {
+    req.msg = chunks[i];
+    req.id = first + i;
+    req.part = i;
+    req.parts = chunks.size();
+    reqs.emplace_back(chat_dump(req));
+  }
+
+  // queued together so they go out in the same gather write
+  boost::asio::dispatch(strand_,
+    [this, reqs = std::move(reqs), first, sent]()
+    {
+      for (std::size_t i = 0; i < reqs.size(); ++i)
+      {
+        place(reqs[i], first + i, sent);
+      }
+
+      kick();
+    }
+  );
+
+  return first;
+}
+
+template<typename Protocol>
+std::vector<std::string> chat_basic_client<Protocol>::split(std::string const& text, std::size_t budget)
+{
+  // bytes a character takes once escaped in a json string
+  auto const escaped = [](unsigned char c) -> std::size_t
+  {
+    switch (c)
+    {
+      case '"': case '\\': case '\b': case '\f': case '\n': case '\r': case '\t':
+        return 2;
+      default:
+        return c < 0x20 ? 6 : 1;
+    }
+  };
+
+  std::vector<std::string> chunks;
+  std::size_t pos {0};
+  while (pos < text.size())
+  {
+    std::size_t end {pos};
+    std::size_t used {0};
+    while (end < text.size() && used + escaped(static_cast<unsigned char>(text[end])) <= budget)
+    {
+      used += escaped(static_cast<unsigned char>(text[end]));
+      ++end;
+    }
+
+    // never cut a utf-8 sequence in half
+    if (end < text.size())
+    {
+      auto const cut = end;
+      while (end > pos && (static_cast<unsigned char>(text[end]) & 0xc0) == 0x80)
+      {
+        --end;
+      }
+      if (end == pos)
+      {
+        end = cut;
+      }
+    }
+
+    chunks.emplace_back(text, pos, end - pos);
+    pos = end;
+  }
+
+  return chunks;
+}
+
+template<typename Protocol>
+bool chat_basic_client<Protocol>::prv(std::string const& to, std::string const& text)
+{
+  if (! chat_utf8_valid(to.data(), to.size()) || ! chat_utf8_valid(text.data(), text.size()))
+  {
+    return false;
+  }
+
+  chat_prv req;
+  req.to = to;
+  req.msg = text;
+
+  auto const str = chat_dump(req);
+  if (str.empty())
+  {
+    return false;
+  }
+
+  return queue(str, 0);
+}
+
+template<typename Protocol>
+bool chat_basic_client<Protocol>::subscribe(bool mentions, std::string const& from, std::string const& words)
+{
+  chat_sub req;
+  req.mentions = mentions ? 1 : 0;
+  req.from = from;
+  req.words = words;
+
+  auto str = chat_dump(req);
+  if (str.empty())
+  {
+    return false;
+  }
+
+  boost::asio::dispatch(strand_,
+    [this, str = std::move(str)]()
+    {
+      sub_req_ = str;
+      do_queue(str, 0, clock::now());
+    }
+  );
+
+  return true;
+}
+
+template<typename Protocol>
+bool chat_basic_client<Protocol>::write(Json& jreq)
+{
+  std::uint64_t id {0};
+  if (jreq["type"] == "msg")
+  {
+    // measured with the longest id, an id is only taken for a message that
+    // is queued, the strand waits for every id in turn
+    jreq["id"] = std::numeric_limits<std::uint64_t>::max();
+    if (jreq.dump().size() > chat_message::max_body_length)
+    {
+      return false;
+    }
+
+    id = next_id_.fetch_add(1);
+    jreq["id"] = id;
+  }
+
+  return queue(jreq.dump(), id);
+}
+
+template<typename Protocol>
+bool chat_basic_client<Protocol>::write(std::string const& req)
+{
+  return queue(req, 0);
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::close()
+{
+  boost::asio::dispatch(strand_,
+    [this]()
+    {
+      closing_ = true;
+      timer_.cancel();
+
+      if (sending_ && ! writing_ && outbox_.size() == written_)
+      {
+        do_shutdown();
+      }
+    }
+  );
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::pause()
+{
+  boost::asio::dispatch(strand_,
+    [this]()
+    {
+      paused_ = true;
+    }
+  );
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::resume()
+{
+  boost::asio::dispatch(strand_,
+    [this]()
+    {
+      paused_ = false;
+      if (ready_ && ! reading_)
+      {
+        reading_ = true;
+        do_read();
+      }
+    }
+  );
+}
+
+template<typename Protocol>
+bool chat_basic_client<Protocol>::queue(std::string req, std::uint64_t id)
+{
+  // check length of req string
+  if (req.size() > chat_message::max_body_length)
+  {
+    return false;
+  }
+
+  // latency is measured from here, before any queueing
+  auto const sent = clock::now();
+
+  boost::asio::dispatch(strand_,
+    [this, req = std::move(req), id, sent]()
+    {
+      do_queue(req, id, sent);
+    }
+  );
+
+  return true;
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::do_queue(std::string const& req, std::uint64_t id,
+  clock::time_point sent)
+{
+  place(req, id, sent);
+  kick();
+}
+
+// ids are taken on the calling thread, so room messages queued from
+// several threads can reach the strand out of order, one that overtook
+// another is held back until those before it are in, the outbox stays in
+// id order for retire and trim
+template<typename Protocol>
+void chat_basic_client<Protocol>::place(std::string const& req, std::uint64_t id,
+  clock::time_point sent)
+{
+  if (id && id != queued_id_ + 1)
+  {
+    early_.emplace(std::piecewise_construct, std::forward_as_tuple(id),
+      std::forward_as_tuple(req, sent));
+    return;
+  }
+
+  push(req, id, sent);
+
+  if (! id)
+  {
+    return;
+  }
+
+  queued_id_ = id;
+
+  for (auto it = early_.begin(); it != early_.end() && it->first == queued_id_ + 1;
+    it = early_.erase(it))
+  {
+    push(it->second.first, it->first, it->second.second);
+    queued_id_ = it->first;
+  }
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::push(std::string const& req, std::uint64_t id,
+  clock::time_point sent)
+{
+  if (closed_)
+  {
+    return;
+  }
+
+  // the frame is built in place
+  outbox_.emplace_back(req, id, sent);
+  if (id)
+  {
+    ++unacked_;
+  }
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::kick()
+{
+  if (! writing_ && sending_ && outbox_.size() > written_)
+  {
+    do_write();
+  }
+}
+
+template<typename Protocol>
+std::string chat_basic_client<Protocol>::auth_request() const
+{
+  if (! token_.empty())
+  {
+    chat_watch req;
+    req.token = token_;
+    req.since = last_seq_;
+    req.lossy = lossy_ ? 1 : 0;
+
+    return chat_dump(req);
+  }
+
+  chat_auth req;
+  req.user = user_;
+  req.pass = pass_;
+
+  // only ask for what was missed
+  req.since = last_seq_;
+  req.acks = acks_ ? 1 : 0;
+
+  return chat_dump(req);
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::do_connect()
+{
+  // race a connect to every endpoint, the first one to complete is the
+  // fastest and is kept, the others are closed
+  auto const generation = ++probe_generation_;
+  probes_.clear();
+  probes_left_ = endpoints_.size();
+
+  if (endpoints_.empty())
+  {
+    do_close();
+    return;
+  }
+
+  auto const start = clock::now();
+
+  for (auto const& endpoint : endpoints_)
+  {
+    auto probe = std::make_shared<socket_type>(socket_.get_executor());
+    probes_.emplace_back(probe);
+
+    probe->async_connect(endpoint,
+      boost::asio::bind_executor(strand_,
+        [this, probe, endpoint, generation, start](boost::system::error_code ec)
+        {
+          if (generation != probe_generation_)
+          {
+            // a late probe from an earlier round, or the race is already won
+            boost::system::error_code ignored;
+            probe->close(ignored);
+            return;
+          }
+
+          --probes_left_;
+
+          if (ec)
+          {
+            if (probes_left_ == 0 && ec != boost::asio::error::operation_aborted)
+            {
+              do_close();
+            }
+            return;
+          }
+
+          // this probe won, the rest are dropped
+          ++probe_generation_;
+          for (auto const& other : probes_)
+          {
+            if (other != probe)
+            {
+              boost::system::error_code ignored;
+              other->close(ignored);
+            }
+          }
+          probes_.clear();
+
+          socket_ = std::move(*probe);
+          no_delay(socket_);
+          on_connected(endpoint, clock::now() - start);
+        }
+      )
+    );
+  }
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::on_connected(endpoint_type const& endpoint, clock::duration elapsed)
+{
+  ready_ = true;
+  shutdown_ = false;
+  connected_once_ = true;
+  reading_ = true;
+  do_read();
+  do_ping();
+
+  if (on_connect_)
+  {
+    on_connect_(endpoint, static_cast<std::size_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+  }
+
+  if (reconnecting_ && (! user_.empty() || ! token_.empty()))
+  {
+    do_login();
+    return;
+  }
+
+  start_sending();
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::do_login()
+{
+  // log back in first, the outbox is replayed once the server confirms the
+  // login and has resent what was missed
+  auth_msg_ = chat_message {auth_request()};
+  login_pending_ = true;
+
+  std::vector<boost::asio::const_buffer> bufs;
+  bufs.emplace_back(boost::asio::buffer(auth_msg_.data(), auth_msg_.length()));
+
+  // the subscription goes with it, before any room message is sent
+  if (! sub_req_.empty())
+  {
+    sub_msg_ = chat_message {sub_req_};
+    bufs.emplace_back(boost::asio::buffer(sub_msg_.data(), sub_msg_.length()));
+  }
+
+  boost::asio::async_write(socket_, bufs,
+    boost::asio::bind_executor(strand_,
+      [this](boost::system::error_code ec, std::size_t /*length*/)
+      {
+        if (ec)
+        {
+          do_close();
+        }
+      }
+    )
+  );
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::start_sending()
+{
+  sending_ = true;
+  reconnecting_ = false;
+
+  if (! writing_ && outbox_.size() > written_)
+  {
+    do_write();
+  }
+  else if (closing_)
+  {
+    do_shutdown();
+  }
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::do_read()
+{
+  socket_.async_read_some(
+    boost::asio::buffer(read_buf_ + read_end_, read_length - read_end_),
+    boost::asio::bind_executor(strand_,
+      [this](boost::system::error_code ec, std::size_t length)
+      {
+        if (ec)
+        {
+          do_close();
+          return;
+        }
+
+        read_end_ += length;
+
+        // hand every complete frame in the buffer to the frame handler
+        std::size_t pos {0};
+        while (ready_ && read_end_ - pos >= chat_message::header_length)
+        {
+          std::size_t body_length {0};
+          if (! chat_message::decode_header(read_buf_ + pos, body_length))
+          {
+            do_close();
+            return;
+          }
+
+          if (read_end_ - pos - chat_message::header_length < body_length)
+          {
+            break;
+          }
+
+          handle_frame(read_buf_ + pos + chat_message::header_length, body_length);
+          pos += chat_message::header_length + body_length;
+        }
+
+        if (! ready_)
+        {
+          return;
+        }
+
+        // keep the partial frame at the front of the buffer
+        std::memmove(read_buf_, read_buf_ + pos, read_end_ - pos);
+        read_end_ -= pos;
+
+        if (paused_)
+        {
+          reading_ = false;
+          return;
+        }
+
+        do_read();
+      }
+    )
+  );
+}
+
+namespace
+{
+
+std::uint64_t now_us()
+{
+  return static_cast<std::uint64_t>(
+    std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+} // namespace
+
+template<typename Protocol>
+chat_dispatch<typename chat_basic_client<Protocol>::frame_handler> const&
+chat_basic_client<Protocol>::handlers()
+{
+  static chat_dispatch<frame_handler> const handlers {chat_dispatch<frame_handler> {}
+    .on(chat_type::msg, &chat_basic_client::handle_msg)
+    .on(chat_type::prv, &chat_basic_client::handle_prv)
+    .on(chat_type::srv, &chat_basic_client::handle_srv)
+    .on(chat_type::ack, &chat_basic_client::handle_ack)
+  };
+
+  return handlers;
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::handle_frame(char const* body, std::size_t length)
+{
+  if (! reader_.parse(body, length))
+  {
+    return;
+  }
+
+  auto const type = reader_.type();
+
+  if (type == chat_type::pong)
+  {
+    // latency probes are answered by the server and stay in the client
+    auto const sent = reader_.get<chat_pong>().t;
+    auto const now = now_us();
+    ping_pending_ = false;
+    if (sent && sent <= now)
+    {
+      stats_.rtt.record(now - sent);
+    }
+    return;
+  }
+
+  if (on_frame_)
+  {
+    on_frame_({body, length});
+  }
+
+  // look up the handler for the type and perform action
+  auto const handler = handlers()[type];
+  if (handler)
+  {
+    (this->*handler)({body, length});
+  }
+
+  if (on_json_)
+  {
+    // only built when asked for
+    on_json_(Json::parse(body, body + length, nullptr, false));
+  }
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::handle_msg(boost::string_view body)
+{
+  auto const res = reader_.get<chat_msg>();
+
+  chat_msg_view view;
+  view.body = body;
+  view.user = res.user;
+  view.msg = res.msg;
+  view.seq = res.seq;
+  view.id = res.id;
+
+  if (view.seq)
+  {
+    // remember how far we got, used to resync after a reconnect
+    last_seq_ = view.seq;
+  }
+
+  // our own message is acked once it has been passed on, so on_msg sees it
+  // before on_ack does, the parts before the last are only retired
+  auto const own = view.id && view.user == user_ ? view.id : 0;
+
+  if (res.parts > 1 && ! reassemble(view, res.part, res.parts))
+  {
+    if (own)
+    {
+      retire(own);
+    }
+    return;
+  }
+
+  if (on_msg_)
+  {
+    on_msg_(view);
+  }
+
+  if (own)
+  {
+    do_ack(own);
+  }
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::handle_prv(boost::string_view /*body*/)
+{
+  auto const res = reader_.get<chat_prv>();
+
+  chat_prv_view view;
+  view.from = res.from;
+  view.msg = res.msg;
+
+  if (on_prv_)
+  {
+    on_prv_(view);
+  }
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::handle_srv(boost::string_view /*body*/)
+{
+  auto const res = reader_.get<chat_srv>();
+
+  if (res.seq.set)
+  {
+    // login confirmed, the missed messages have been replayed
+    login_pending_ = false;
+    backoff_ = backoff_min;
+    if (! sending_)
+    {
+      start_sending();
+    }
+  }
+  else if (login_pending_ && ! res.id.set && res.str.starts_with("Error"))
+  {
+    // the login was refused, other replies can overtake the confirmation
+    // but are never errors, it would only be refused again after every
+    // reconnect, so the credentials are dropped and the client closes for
+    // good once the server hangs up
+    login_pending_ = false;
+    user_.clear();
+    pass_.clear();
+    token_.clear();
+    closing_ = true;
+    timer_.cancel();
+  }
+
+  // a rejected room message is never echoed, it is done with as it is
+  if (res.id.set && ! retire(res.id.value))
+  {
+    return;
+  }
+
+  chat_srv_view view;
+  view.str = res.str;
+  view.login = res.seq.set;
+  view.seq = res.seq.value;
+  view.id = res.id.value;
+
+  if (on_srv_)
+  {
+    on_srv_(view);
+  }
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::handle_ack(boost::string_view /*body*/)
+{
+  auto const res = reader_.get<chat_ack>();
+
+  // acks can overtake room messages queued before them, so they don't move
+  // the resync point, after a reconnect our own messages may come back in
+  // the replay with ids that are already acked
+  if (res.id)
+  {
+    do_ack(res.id);
+  }
+}
+
+template<typename Protocol>
+bool chat_basic_client<Protocol>::reassemble(chat_msg_view& view, std::uint64_t part, std::uint64_t parts)
+{
+  // chunks of one message share the id of their first part
+  auto const group = view.id - part;
+  std::string key {view.user.data(), view.user.size()};
+  key += ':';
+  key += std::to_string(group);
+
+  if (part == 0)
+  {
+    if (partials_.size() >= max_partials)
+    {
+      partials_.clear();
+    }
+
+    auto& started = partials_[key];
+    started.text.assign(view.msg.data(), view.msg.size());
+    started.next = 1;
+    return false;
+  }
+
+  auto const it = partials_.find(key);
+  if (it == partials_.end() || it->second.next != part)
+  {
+    // a part went missing, drop the message
+    if (it != partials_.end())
+    {
+      partials_.erase(it);
+    }
+    return false;
+  }
+
+  it->second.text.append(view.msg.data(), view.msg.size());
+  ++it->second.next;
+
+  if (part + 1 < parts)
+  {
+    return false;
+  }
+
+  // complete, the view points at the reassembled text until the next frame
+  assembled_ = std::move(it->second.text);
+  partials_.erase(it);
+
+  view.msg = assembled_;
+  view.id = group;
+  return true;
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::do_ack(std::uint64_t id)
+{
+  // echoes replayed from before this client sent anything, of a previous
+  // run using the same ids, are not acks
+  if (id <= acked_id_ || id > sent_id_)
+  {
+    return;
+  }
+
+  for (auto const& out : outbox_)
+  {
+    if (out.id == id)
+    {
+      stats_.e2e.record(static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+        clock::now() - out.sent).count()));
+      break;
+    }
+
+    if (out.id > id)
+    {
+      break;
+    }
+  }
+
+  retire(id);
+
+  if (on_ack_)
+  {
+    on_ack_(id);
+  }
+}
+
+// the server is done with the room messages up to id, echoed, acked or
+// rejected, they are dropped from the outbox, false if id is stale
+template<typename Protocol>
+bool chat_basic_client<Protocol>::retire(std::uint64_t id)
+{
+  if (id <= acked_id_ || id > sent_id_)
+  {
+    return false;
+  }
+
+  acked_id_ = id;
+  trim();
+
+  return true;
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::trim()
+{
+  // drop the entries at the front of the outbox that are done with
+  while (! outbox_.empty())
+  {
+    auto const& front = outbox_.front();
+    bool const done {front.id ? front.id <= acked_id_ : written_ > 0};
+
+    // never drop a frame that is part of the write in flight
+    if (! done || (written_ == 0 && writing_))
+    {
+      break;
+    }
+
+    if (front.id)
+    {
+      --unacked_;
+    }
+
+    outbox_.pop_front();
+    if (written_)
+    {
+      --written_;
+    }
+  }
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::do_write()
+{
+  // gather every queued frame into a single write, so a split message
+  // leaves as one burst, asio itself bounds each writev to its iov limit
+  write_bufs_.clear();
+  for (auto it = outbox_.begin() + static_cast<std::ptrdiff_t>(written_);
+    it != outbox_.end(); ++it)
+  {
+    write_bufs_.emplace_back(boost::asio::buffer(it->frame.data(), it->frame.length()));
+    sent_id_ = std::max(sent_id_, it->id);
+  }
+  writing_ = write_bufs_.size();
+
+  boost::asio::async_write(socket_, write_bufs_,
+    boost::asio::bind_executor(strand_,
+      [this](boost::system::error_code ec, std::size_t /*length*/)
+      {
+        auto const count = writing_;
+        writing_ = 0;
+
+        if (!ec)
+        {
+          written_ += count;
+          trim();
+
+          if (outbox_.size() > written_)
+          {
+            do_write();
+          }
+          else if (closing_)
+          {
+            do_shutdown();
+            return;
+          }
+
+          if (on_writable_ && outbox_.size() - written_ < low_watermark_)
+          {
+            auto writable = std::move(on_writable_);
+            on_writable_ = nullptr;
+            writable();
+          }
+        }
+        else
+        {
+          do_close();
+        }
+      }
+    )
+  );
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::do_shutdown()
+{
+  if (! ready_)
+  {
+    do_close();
+    return;
+  }
+
+  // only once per connection, close may be called again while waiting
+  if (shutdown_)
+  {
+    return;
+  }
+  shutdown_ = true;
+
+  // shut down the sending side, the read loop sees the server close its side
+  boost::system::error_code ec;
+  socket_.shutdown(socket_type::shutdown_send, ec);
+
+  if (ec)
+  {
+    do_close();
+  }
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::do_close()
+{
+  if (closed_)
+  {
+    return;
+  }
+
+  // a connection that was up fails over right away
+  bool const was_ready {ready_};
+
+  ready_ = false;
+  sending_ = false;
+  reading_ = false;
+  read_end_ = 0;
+
+  boost::system::error_code ec;
+  socket_.close(ec);
+
+  ++probe_generation_;
+  for (auto const& probe : probes_)
+  {
+    probe->close(ec);
+  }
+  probes_.clear();
+  ping_timer_.cancel();
+  ping_pending_ = false;
+
+  if (closing_ || ! connected_once_)
+  {
+    closed_ = true;
+    outbox_.clear();
+    early_.clear();
+
+    if (on_close_)
+    {
+      on_close_();
+    }
+    return;
+  }
+
+  // frames written without expecting an echo are not sent twice, room
+  // messages still waiting for their echo are replayed
+  std::size_t kept {0};
+  for (std::size_t i = 0; i < outbox_.size(); ++i)
+  {
+    if (i >= written_ || outbox_[i].id)
+    {
+      if (kept != i)
+      {
+        outbox_[kept] = std::move(outbox_[i]);
+      }
+      ++kept;
+    }
+  }
+  outbox_.resize(kept, outbound {"", 0, {}});
+  written_ = 0;
+  writing_ = 0;
+
+  do_reconnect(was_ready);
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::do_reconnect(bool immediate)
+{
+  reconnecting_ = true;
+
+  // exponential backoff with jitter so clients don't reconnect in lockstep,
+  // only the first retry after a good session skips the wait
+  std::size_t delay {0};
+  if (! immediate || backoff_ != backoff_min)
+  {
+    std::uniform_int_distribution<std::size_t> jitter {backoff_ / 2, backoff_};
+    delay = jitter(rng_);
+  }
+  backoff_ = std::min<std::size_t>(backoff_ * 2, backoff_max);
+
+  if (on_disconnect_)
+  {
+    on_disconnect_(delay);
+  }
+
+  timer_.expires_after(std::chrono::milliseconds(delay));
+  timer_.async_wait(
+    boost::asio::bind_executor(strand_,
+      [this](boost::system::error_code ec)
+      {
+        if (ec)
+        {
+          if (closing_)
+          {
+            do_close();
+          }
+          return;
+        }
+
+        do_connect();
+      }
+    )
+  );
+}
+
+template<typename Protocol>
+void chat_basic_client<Protocol>::do_ping()
+{
+  if (ping_interval_.count() == 0 || ! ready_)
+  {
+    return;
+  }
+
+  // keep a single probe outstanding, and none while waiting on a login
+  if (sending_ && ! ping_pending_)
+  {
+    chat_ping req;
+    req.t = now_us();
+    do_queue(chat_dump(req), 0, clock::now());
+    ping_pending_ = true;
+  }
+
+  ping_timer_.expires_after(ping_interval_);
+  ping_timer_.async_wait(
+    boost::asio::bind_executor(strand_,
+      [this](boost::system::error_code ec)
+      {
+        if (! ec)
+        {
+          do_ping();
+        }
+      }
+    )
+  );
+}
+
+template class chat_basic_client<boost::asio::ip::tcp>;
+template class chat_basic_client<boost::asio::local::stream_protocol>;
+template class chat_basic_client<boost::asio::generic::stream_protocol>;
+template class chat_basic_client<chat_shm_protocol>;
@@ -0,0 +1,407 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// This is a derivative work, original copyright below:
+// Copyright (c) 2003-2018 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+
+#ifndef CHAT_CLIENT_HPP
+#define CHAT_CLIENT_HPP
+
+#include "chat_histogram.hh"
+#include "chat_message.hh"
+#include "chat_proto.hh"
+#include "chat_shm.hh"
+#include "chat_type.hh"
+
+#include "json.hh"
+
+#include <boost/asio.hpp>
+#include <boost/utility/string_view.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// views over a received frame, only valid for the duration of the callback
+
+struct chat_msg_view
+{
+  // the whole frame body
+  boost::string_view body;
+
+  boost::string_view user;
+  boost::string_view msg;
+  std::uint64_t seq {0};
+  std::uint64_t id {0};
+};
+
+struct chat_prv_view
+{
+  boost::string_view from;
+  boost::string_view msg;
+};
+
+struct chat_srv_view
+{
+  boost::string_view str;
+
+  // the login confirmation, which carries the room's last sequence number
+  bool login {false};
+  std::uint64_t seq {0};
+
+  // set when the server rejected a room message, its client id, the
+  // message is retired as if it had been acked
+  std::uint64_t id {0};
+};
+
+// latencies in microseconds
+struct chat_stats
+{
+  // ping to pong round trip
+  chat_histogram rtt;
+
+  // from sending a room message to its echo, or ack, coming back through
+  // the room
+  chat_histogram e2e;
+
+  nlohmann::json to_json() const
+  {
+    nlohmann::json j;
+    j["rtt_us"] = rtt.to_json();
+    j["e2e_us"] = e2e.to_json();
+    return j;
+  }
+};
+
+// asynchronous chat client
+//
+// all callbacks run on the client's strand, so one io_context can be run from
+// several threads and drive many clients. the public functions may be called
+// from any thread, when called from a callback they run inline.
+// callbacks and the watermark must be set before connect is called.
+//
+// the protocol is the transport, tcp or a unix domain socket, or the
+// generic protocol to pick one per endpoint at run time, or shared memory
+// rings set up over a unix domain socket, instantiated for all four in
+// chat_client.cc
+template<typename Protocol>
+class chat_basic_client
+{
+public:
+
+  using executor_type = boost::asio::strand<boost::asio::io_context::executor_type>;
+  using socket_type = typename Protocol::socket;
+  using endpoint_type = typename Protocol::endpoint;
+  using endpoints_type = std::vector<endpoint_type>;
+
+  // room kept free in a message frame for the user and seq fields the
+  // server adds before passing it on to the room
+  enum { stamp_length = 128 };
+
+  // max number of split messages being reassembled at once
+  enum { max_partials = 64 };
+
+  // size of the receive buffer, always larger than a single frame
+  enum { read_length = 65536 };
+
+  // reconnect backoff bounds in milliseconds
+  enum { backoff_min = 100 };
+  enum { backoff_max = 10000 };
+
+  explicit chat_basic_client(boost::asio::io_context& io_context);
+
+  chat_basic_client(chat_basic_client const&) = delete;
+  chat_basic_client& operator=(chat_basic_client const&) = delete;
+
+  executor_type const& executor() const
+  {
+    return strand_;
+  }
+
+  // connect to whichever endpoint answers first, on every reconnect the
+  // endpoints are raced again so a dead server is failed over quickly
+  void connect(endpoints_type const& endpoints);
+
+  // authenticate now and again after every reconnect, a refused login
+  // closes the client for good
+  bool login(std::string const& user, std::string const& pass);
+
+  // join as a read only observer instead of logging in, now and again after
+  // every reconnect, a lossy observer has room messages dropped when it
+  // falls behind instead of being disconnected, a refused token closes the
+  // client for good
+  bool watch(std::string const& token, bool lossy);
+
+  // only ask the server for room messages after seq, for clients that keep
+  // their own history, must be called before connect
+  void since(std::uint64_t seq)
+  {
+    last_seq_ = seq;
+  }
+
+  // have the server ack the client's own room messages instead of echoing
+  // them back, they are then not passed to on_msg, must be called before
+  // connect
+  void acks(bool value)
+  {
+    acks_ = value;
+  }
+
+  // send a message to the room, returns its client id, which comes back on
+  // the room echo, text too long for one frame is sent as several parts that
+  // receiving clients reassemble into a single message, 0 if the text is
+  // not valid utf-8
+  std::uint64_t msg(std::string const& text);
+
+  // send a private message to a single user, false if the text is not valid
+  // utf-8 or too long
+  bool prv(std::string const& to, std::string const& text);
+
+  // only receive room messages that mention the user, come from one of the
+  // comma separated users or contain one of the comma separated words,
+  // nothing set receives everything again, sent again after every login
+  bool subscribe(bool mentions, std::string const& from, std::string const& words);
+
+  // queue a json request, room messages get a client id and are kept until
+  // the server echoes them back, returns false if the request is too long
+  bool write(nlohmann::json& jreq);
+
+  // queue a raw request, it is dropped once written
+  bool write(std::string const& req);
+
+  // flush the pending writes, then close the connection
+  void close();
+
+  // stop reading from the socket, used when the consumer falls behind
+  void pause();
+  void resume();
+
+  // interval between latency probes, 0 disables them
+  void ping_interval(std::chrono::milliseconds interval)
+  {
+    ping_interval_ = interval;
+  }
+
+  // only valid on the strand
+  chat_stats const& stats() const
+  {
+    return stats_;
+  }
+
+  // the input side stops above the high mark and resumes below the low mark
+  void watermark(std::size_t high)
+  {
+    high_watermark_ = high;
+    low_watermark_ = std::max<std::size_t>(1, high / 4);
+  }
+
+  // only valid on the strand
+  bool writable() const
+  {
+    return outbox_.size() - written_ < high_watermark_;
+  }
+
+  // number of room messages not yet echoed back or acked by the server, only
+  // valid on the strand
+  std::size_t unacked() const
+  {
+    return unacked_;
+  }
+
+  // called for every received frame with its raw json body
+  void on_frame(std::function<void(boost::string_view)> handler)
+  {
+    on_frame_ = std::move(handler);
+  }
+
+  // called for every received frame after parsing
+  void on_json(std::function<void(nlohmann::json const&)> handler)
+  {
+    on_json_ = std::move(handler);
+  }
+
+  void on_msg(std::function<void(chat_msg_view const&)> handler)
+  {
+    on_msg_ = std::move(handler);
+  }
+
+  void on_prv(std::function<void(chat_prv_view const&)> handler)
+  {
+    on_prv_ = std::move(handler);
+  }
+
+  void on_srv(std::function<void(chat_srv_view const&)> handler)
+  {
+    on_srv_ = std::move(handler);
+  }
+
+  // called once the write queue drains below the low watermark
+  void on_writable(std::function<void()> handler)
+  {
+    on_writable_ = std::move(handler);
+  }
+
+  // called when the server echoes back or acks one of our room messages,
+  // after on_msg for an echo
+  void on_ack(std::function<void(std::uint64_t)> handler)
+  {
+    on_ack_ = std::move(handler);
+  }
+
+  // called when a connection is established, with the endpoint that won
+  // the race and its connect time in microseconds
+  void on_connect(std::function<void(endpoint_type const&, std::size_t)> handler)
+  {
+    on_connect_ = std::move(handler);
+  }
+
+  // called when the connection drops, with the reconnect delay in ms
+  void on_disconnect(std::function<void(std::size_t)> handler)
+  {
+    on_disconnect_ = std::move(handler);
+  }
+
+  // called once the connection is closed for good
+  void on_close(std::function<void()> handler)
+  {
+    on_close_ = std::move(handler);
+  }
+
+private:
+
+  using clock = std::chrono::steady_clock;
+
+  struct outbound
+  {
+    outbound(std::string const& req, std::uint64_t id_, clock::time_point sent_) :
+      id {id_},
+      sent {sent_},
+      frame {req}
+    {
+    }
+
+    // client id of a room message, 0 if no echo is expected
+    std::uint64_t id;
+    clock::time_point sent;
+    chat_message frame;
+  };
+
+  struct partial
+  {
+    std::string text;
+    std::uint64_t next {0};
+  };
+
+  static std::vector<std::string> split(std::string const& text, std::size_t budget);
+  bool reassemble(chat_msg_view& view, std::uint64_t part, std::uint64_t parts);
+  bool queue(std::string req, std::uint64_t id);
+  void do_queue(std::string const& req, std::uint64_t id, clock::time_point sent);
+  void place(std::string const& req, std::uint64_t id, clock::time_point sent);
+  void push(std::string const& req, std::uint64_t id, clock::time_point sent);
+  void kick();
+  std::string auth_request() const;
+  void do_connect();
+  void on_connected(endpoint_type const& endpoint, clock::duration elapsed);
+  void do_login();
+  void start_sending();
+  void do_read();
+  using frame_handler = void (chat_basic_client::*)(boost::string_view);
+
+  static chat_dispatch<frame_handler> const& handlers();
+  void handle_frame(char const* body, std::size_t length);
+  void handle_msg(boost::string_view body);
+  void handle_prv(boost::string_view body);
+  void handle_srv(boost::string_view body);
+  void handle_ack(boost::string_view body);
+  void do_ack(std::uint64_t id);
+  bool retire(std::uint64_t id);
+  void trim();
+  void do_write();
+  void do_shutdown();
+  void do_close();
+  void do_reconnect(bool immediate);
+  void do_ping();
+
+  executor_type strand_;
+  socket_type socket_;
+  boost::asio::steady_timer timer_;
+  boost::asio::steady_timer ping_timer_;
+  std::chrono::milliseconds ping_interval_ {1000};
+  bool ping_pending_ {false};
+  chat_stats stats_;
+  endpoints_type endpoints_;
+  std::vector<std::shared_ptr<socket_type>> probes_;
+  std::size_t probes_left_ {0};
+  std::size_t probe_generation_ {0};
+  std::mt19937 rng_;
+  std::size_t backoff_ {backoff_min};
+  bool ready_ {false};
+  bool sending_ {false};
+  bool reconnecting_ {false};
+  bool connected_once_ {false};
+  bool closing_ {false};
+  bool shutdown_ {false};
+  bool closed_ {false};
+  bool paused_ {false};
+  bool reading_ {false};
+  std::size_t high_watermark_ {1024};
+  std::size_t low_watermark_ {256};
+  char read_buf_[read_length];
+  std::size_t read_end_ {0};
+  chat_reader reader_;
+  std::deque<outbound> outbox_;
+  std::size_t written_ {0};
+  std::size_t writing_ {0};
+  std::size_t unacked_ {0};
+  std::atomic<std::uint64_t> next_id_ {1};
+  std::uint64_t queued_id_ {0};
+  std::map<std::uint64_t, std::pair<std::string, clock::time_point>> early_;
+  std::uint64_t acked_id_ {0};
+  std::uint64_t sent_id_ {0};
+  std::uint64_t last_seq_ {0};
+  bool acks_ {false};
+  std::string user_;
+  std::string pass_;
+  std::string token_;
+  bool lossy_ {false};
+  bool login_pending_ {false};
+  chat_message auth_msg_;
+  std::string sub_req_;
+  chat_message sub_msg_;
+  std::unordered_map<std::string, partial> partials_;
+  std::string assembled_;
+  std::vector<boost::asio::const_buffer> write_bufs_;
+  std::function<void(boost::string_view)> on_frame_;
+  std::function<void(nlohmann::json const&)> on_json_;
+  std::function<void(chat_msg_view const&)> on_msg_;
+  std::function<void(chat_prv_view const&)> on_prv_;
+  std::function<void(chat_srv_view const&)> on_srv_;
+  std::function<void()> on_writable_;
+  std::function<void(std::uint64_t)> on_ack_;
+  std::function<void(endpoint_type const&, std::size_t)> on_connect_;
+  std::function<void(std::size_t)> on_disconnect_;
+  std::function<void()> on_close_;
+};
+
+extern template class chat_basic_client<boost::asio::ip::tcp>;
+extern template class chat_basic_client<boost::asio::local::stream_protocol>;
+extern template class chat_basic_client<boost::asio::generic::stream_protocol>;
+extern template class chat_basic_client<chat_shm_protocol>;
+
+using chat_client = chat_basic_client<boost::asio::ip::tcp>;
+using chat_local_client = chat_basic_client<boost::asio::local::stream_protocol>;
+using chat_generic_client = chat_basic_client<boost::asio::generic::stream_protocol>;
+using chat_shm_client = chat_basic_client<chat_shm_protocol>;
+
+#endif // CHAT_CLIENT_HPP
@@ -0,0 +1,130 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CHAT_HISTOGRAM_HPP
+#define CHAT_HISTOGRAM_HPP
+
+#include "json.hh"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+
+// log-linear histogram with a fixed footprint, each power of two is split
+// into 32 buckets so percentiles are within about 3% of the recorded value
+class chat_histogram
+{
+public:
+
+  enum { sub_bits = 5 };
+  enum { sub_count = 1 << sub_bits };
+  enum { bucket_count = (64 - sub_bits + 1) * sub_count };
+
+  void record(std::uint64_t value)
+  {
+    ++buckets_[index(value)];
+    ++count_;
+    sum_ += value;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+  }
+
+  std::uint64_t count() const
+  {
+    return count_;
+  }
+
+  std::uint64_t min() const
+  {
+    return count_ ? min_ : 0;
+  }
+
+  std::uint64_t max() const
+  {
+    return max_;
+  }
+
+  std::uint64_t mean() const
+  {
+    return count_ ? sum_ / count_ : 0;
+  }
+
+  // value below which p percent of the recorded values fall
+  std::uint64_t percentile(double p) const
+  {
+    if (! count_)
+    {
+      return 0;
+    }
+
+    auto const rank = static_cast<std::uint64_t>(
+      std::max(1.0, p / 100.0 * static_cast<double>(count_) + 0.5));
+
+    std::uint64_t seen {0};
+    for (std::size_t i = 0; i < bucket_count; ++i)
+    {
+      seen += buckets_[i];
+      if (seen >= rank)
+      {
+        return std::min(upper(i), max_);
+      }
+    }
+
+    return max_;
+  }
+
+  nlohmann::json to_json() const
+  {
+    nlohmann::json j;
+    j["count"] = count();
+    j["min"] = min();
+    j["mean"] = mean();
+    j["p50"] = percentile(50);
+    j["p90"] = percentile(90);
+    j["p99"] = percentile(99);
+    j["p999"] = percentile(99.9);
+    j["max"] = max();
+    return j;
+  }
+
+private:
+
+  static std::size_t index(std::uint64_t value)
+  {
+    if (value < sub_count)
+    {
+      return static_cast<std::size_t>(value);
+    }
+
+    auto const msb = static_cast<std::size_t>(63 - __builtin_clzll(value));
+    auto const shift = msb - sub_bits;
+    auto const sub = static_cast<std::size_t>(value >> shift) - sub_count;
+
+    return (shift + 1) * sub_count + sub;
+  }
+
+  // largest value that falls into a bucket
+  static std::uint64_t upper(std::size_t i)
+  {
+    if (i < sub_count)
+    {
+      return i;
+    }
+
+    auto const shift = i / sub_count - 1;
+    auto const sub = i % sub_count;
+
+    return ((static_cast<std::uint64_t>(sub_count + sub) + 1) << shift) - 1;
+  }
+
+  std::array<std::uint64_t, bucket_count> buckets_ {};
+  std::uint64_t count_ {0};
+  std::uint64_t sum_ {0};
+  std::uint64_t min_ {std::numeric_limits<std::uint64_t>::max()};
+  std::uint64_t max_ {0};
+};
+
+#endif // CHAT_HISTOGRAM_HPP
@@ -6,7 +6,8 @@
 // This is a derivative work, original copyright below:
 // Copyright (c) 2003-2018 Christopher M. Kohlhoff (chris at kohlhoff dot com)
 
-#include "chat_message.hh"
+#include "chat_client.hh"
+#include "chat_text.hh"
 
 #include "json.hh"
 using Json = nlohmann::json;
@@ -14,356 +15,1328 @@ using Json = nlohmann::json;
 #include <boost/asio.hpp>
 using boost::asio::ip::tcp;
 
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <deque>
+#include <fstream>
+#include <functional>
 #include <iostream>
-#include <thread>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
-#include <atomic>
-
-using chat_message_queue = std::deque<chat_message>;
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
-class chat_client
+class chat_input
 {
 public:
 
-  explicit chat_client(boost::asio::io_context& io_context, std::atomic_bool& connected,
-    const tcp::resolver::results_type& endpoints) :
-    io_context_ {io_context},
-    socket_ {io_context},
-    connected_ {connected}
+  enum { read_length = 65536 };
+
+  // handlers run on the executor of the client the input feeds
+  chat_input(boost::asio::io_context& io_context,
+    chat_generic_client::executor_type const& executor, int fd) :
+    executor_ {executor},
+    input_ {io_context, fd}
   {
-    do_connect(endpoints);
   }
 
-  void write(const chat_message& msg)
+  // called for every complete line, returning false stops the input
+  void on_line(std::function<bool(std::string const&)> handler)
   {
-    boost::asio::post(io_context_,
-      [this, msg]()
-      {
-        bool write_in_progress = !write_msgs_.empty();
-        write_msgs_.push_back(msg);
-        if (!write_in_progress)
-        {
-          do_write();
-        }
-      }
-    );
+    on_line_ = std::move(handler);
+  }
+
+  // called after each chunk of lines, returning false pauses the input until
+  // resume is called
+  void on_chunk(std::function<bool()> handler)
+  {
+    on_chunk_ = std::move(handler);
+  }
+
+  // called once at the end of the input
+  void on_end(std::function<void()> handler)
+  {
+    on_end_ = std::move(handler);
+  }
+
+  void start()
+  {
+    do_read();
+  }
+
+  void resume()
+  {
+    do_read();
   }
 
   void close()
   {
-    boost::asio::post(io_context_,
-      [this]()
-      {
-        do_close();
-      }
-    );
+    boost::system::error_code ec;
+    input_.close(ec);
   }
 
 private:
 
-  void do_connect(const tcp::resolver::results_type& endpoints)
+  void do_read()
   {
-    boost::asio::async_connect(socket_, endpoints,
-      [this](boost::system::error_code ec, tcp::endpoint)
+    input_.async_read_some(boost::asio::buffer(read_buf_),
+      boost::asio::bind_executor(executor_,
+      [this](boost::system::error_code ec, std::size_t length)
       {
-        if (!ec)
+        if (ec)
         {
-          do_read_header();
+          // end of input, handle the last unterminated line
+          if (! line_.empty())
+          {
+            on_line_(line_);
+            line_.clear();
+          }
+
+          on_end_();
+          return;
         }
-        else
+
+        // handle every complete line in the chunk, the resulting frames are
+        // queued together and go out in a single gather write
+        char const* begin {read_buf_};
+        char const* end {read_buf_ + length};
+        while (begin != end)
         {
-          connected_.store(false);
-          return;
+          auto const nl = static_cast<char const*>(
+            std::memchr(begin, '\n', static_cast<std::size_t>(end - begin)));
+
+          if (nl == nullptr)
+          {
+            line_.append(begin, end);
+            break;
+          }
+
+          line_.append(begin, nl);
+          if (! on_line_(line_))
+          {
+            on_end_();
+            return;
+          }
+          line_.clear();
+          begin = nl + 1;
         }
-      }
+
+        if (! on_chunk_ || on_chunk_())
+        {
+          do_read();
+        }
+      })
     );
   }
 
-  void do_read_header()
+  chat_generic_client::executor_type executor_;
+  boost::asio::posix::stream_descriptor input_;
+  char read_buf_[read_length];
+  std::string line_;
+  std::function<bool(std::string const&)> on_line_;
+  std::function<bool()> on_chunk_;
+  std::function<void()> on_end_;
+};
+
+class chat_render
+{
+public:
+
+  struct options
   {
-    boost::asio::async_read(socket_,
-      boost::asio::buffer(read_msg_.data(), chat_message::header_length),
-      [this](boost::system::error_code ec, std::size_t /*length*/)
+    // flushes per second
+    std::size_t fps {60};
+
+    // lines shown per flush once the terminal falls behind, 0 never
+    // collapses
+    std::size_t max_lines {200};
+  };
+
+  // lines held for the terminal, older lines are dropped past this
+  enum { max_queue = 1 << 16 };
+
+  explicit chat_render(options const& opts) :
+    opts_ (opts),
+    thread_ {[this]() { run(); }}
+  {
+  }
+
+  chat_render(chat_render const&) = delete;
+  chat_render& operator=(chat_render const&) = delete;
+
+  ~chat_render()
+  {
+    {
+      std::lock_guard<std::mutex> lock {mutex_};
+      stop_ = true;
+    }
+    cond_.notify_one();
+    thread_.join();
+  }
+
+  // queue a line for the next flush, never blocks on the terminal
+  void push(std::string line)
+  {
+    std::lock_guard<std::mutex> lock {mutex_};
+
+    if (queue_.size() == max_queue)
+    {
+      queue_.pop_front();
+      ++dropped_;
+    }
+
+    queue_.emplace_back(std::move(line));
+  }
+
+private:
+
+  void run()
+  {
+    auto const interval = std::chrono::microseconds(1000000 / std::max<std::size_t>(1, opts_.fps));
+    std::deque<std::string> lines;
+    std::string out;
+    bool behind {false};
+
+    for (bool stop {false}; ! stop;)
+    {
+      std::size_t skipped {0};
+      {
+        std::unique_lock<std::mutex> lock {mutex_};
+        cond_.wait_for(lock, interval, [this]() { return stop_; });
+
+        stop = stop_;
+        lines.swap(queue_);
+        skipped = dropped_;
+        dropped_ = 0;
+      }
+
+      if (lines.empty() && ! skipped)
+      {
+        continue;
+      }
+
+      // the terminal fell behind, summarize the burst and show its tail
+      if (behind && opts_.max_lines && lines.size() > opts_.max_lines)
       {
-        if (!ec && read_msg_.decode_header())
+        skipped += lines.size() - opts_.max_lines;
+        lines.erase(lines.begin(), lines.end() - static_cast<std::ptrdiff_t>(opts_.max_lines));
+      }
+
+      out.clear();
+      if (skipped)
+      {
+        out += "+" + std::to_string(skipped) + " messages\n";
+      }
+      for (auto const& line : lines)
+      {
+        out += line;
+        out += '\n';
+      }
+      lines.clear();
+
+      // a write that blocks for half a frame means the terminal can't keep up
+      auto const start = std::chrono::steady_clock::now();
+      write_all(out);
+      behind = std::chrono::steady_clock::now() - start > interval / 2;
+    }
+  }
+
+  // one write per flush, stdout may share a non-blocking file description
+  // with stdin
+  static void write_all(std::string const& str)
+  {
+    char const* data {str.data()};
+    std::size_t size {str.size()};
+
+    while (size)
+    {
+      auto const n = ::write(STDOUT_FILENO, data, size);
+      if (n < 0)
+      {
+        if (errno == EINTR)
         {
-          do_read_body();
+          continue;
         }
-        else
+
+        // the two are the same value on linux
+#if EAGAIN != EWOULDBLOCK
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+#else
+        if (errno == EAGAIN)
+#endif
         {
-          do_close();
+          pollfd pfd {STDOUT_FILENO, POLLOUT, 0};
+          ::poll(&pfd, 1, -1);
+          continue;
         }
+
+        return;
       }
-    );
+
+      data += n;
+      size -= static_cast<std::size_t>(n);
+    }
   }
 
-  void do_read_body()
+  options opts_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::string> queue_;
+  std::size_t dropped_ {0};
+  bool stop_ {false};
+  std::thread thread_;
+};
+
+class chat_cache
+{
+public:
+
+  // compact the file on load once it holds more lines than this
+  enum { max_lines = 16384 };
+
+  explicit chat_cache(std::string const& path) :
+    path_ {path}
   {
-    boost::asio::async_read(socket_,
-      boost::asio::buffer(read_msg_.body(), read_msg_.body_length()),
-      [this](boost::system::error_code ec, std::size_t /*length*/)
+    std::deque<std::string> lines;
+
+    std::ifstream in {path_};
+    std::string line;
+    while (std::getline(in, line))
+    {
+      // a corrupt line is skipped, value() would throw on a field of the
+      // wrong type
+      Json jmsg = Json::parse(line, nullptr, false);
+      if (jmsg.is_discarded() || ! jmsg.is_object())
       {
-        if (!ec)
-        {
-          // parse json from body
-          std::string res {read_msg_.body(), read_msg_.body_length()};
-          Json jres = Json::parse(res);
-          std::string type {jres["type"].get<std::string>()};
+        continue;
+      }
 
-          // switch on type and perform action
-          if (type == "msg")
-          {
-            // regular message
-            std::string user {jres["user"].get<std::string>()};
-            std::string msg {jres["msg"].get<std::string>()};
-            std::cout << user << "> " << msg << "\n";
-          }
-          else if (type == "prv")
-          {
-            // private message
-            std::string from {jres["from"].get<std::string>()};
-            std::string msg {jres["msg"].get<std::string>()};
-            std::cout << "[prv]" << from << "> " << msg << "\n";
-          }
-          else if (type == "srv")
-          {
-            // server message
-            std::string str {jres["str"].get<std::string>()};
-            std::cout << "server> " << str << "\n";
-          }
-          // else if (type == "")
-          // {
-          //   // do something else
-          // }
+      auto const seq = jmsg.find("seq");
+      auto const user = jmsg.find("user");
+      auto const msg = jmsg.find("msg");
+      if (seq == jmsg.end() || ! seq->is_number_unsigned() ||
+        user == jmsg.end() || ! user->is_string() ||
+        msg == jmsg.end() || ! msg->is_string())
+      {
+        continue;
+      }
 
-          do_read_header();
-        }
-        else
-        {
-          do_close();
-        }
+      if (seq->get<std::uint64_t>() <= seq_)
+      {
+        continue;
       }
-    );
+
+      seq_ = seq->get<std::uint64_t>();
+      msgs_.emplace_back(user->get<std::string>() + "> " + msg->get<std::string>());
+      lines.emplace_back(std::move(line));
+    }
+    in.close();
+
+    if (lines.size() > max_lines)
+    {
+      // keep the newer half
+      lines.erase(lines.begin(), lines.end() - max_lines / 2);
+      msgs_.erase(msgs_.begin(), msgs_.end() - max_lines / 2);
+
+      std::ofstream out {path_, std::ios::trunc};
+      for (auto const& str : lines)
+      {
+        out << str << "\n";
+      }
+    }
+
+    out_.open(path_, std::ios::app);
   }
 
-  void do_write()
+  // cached room messages formatted for display, oldest first
+  std::deque<std::string> const& msgs() const
   {
-    boost::asio::async_write(socket_,
-      boost::asio::buffer(write_msgs_.front().data(),
-      write_msgs_.front().length()),
-      [this](boost::system::error_code ec, std::size_t /*length*/)
+    return msgs_;
+  }
+
+  // highest cached sequence number
+  std::uint64_t seq() const
+  {
+    return seq_;
+  }
+
+  void append(chat_msg_view const& msg)
+  {
+    if (msg.seq <= seq_)
+    {
+      // a replay of what is already cached, or of a restarted server that
+      // numbers its messages from scratch, only the login confirmation
+      // tells which, so it is held until then
+      held_.emplace_back(msg.seq, line(msg));
+      return;
+    }
+
+    seq_ = msg.seq;
+    out_ << line(msg) << "\n";
+  }
+
+  // the login is confirmed with the room's last sequence number, a room
+  // behind the cache is a restarted server, the cache starts over from the
+  // messages it replayed
+  void confirm(std::uint64_t room_seq)
+  {
+    if (room_seq < seq_)
+    {
+      out_.close();
+      out_.open(path_, std::ios::trunc);
+      seq_ = 0;
+
+      for (auto const& held : held_)
       {
-        if (!ec)
-        {
-          write_msgs_.pop_front();
-          if (!write_msgs_.empty())
-          {
-            do_write();
-          }
-        }
-        else
+        if (held.first > seq_)
         {
-          do_close();
+          seq_ = held.first;
+          out_ << held.second << "\n";
         }
       }
-    );
+    }
+
+    held_.clear();
   }
 
-  void do_close()
+private:
+
+  static std::string line(chat_msg_view const& msg)
   {
-    connected_.store(false);
-    socket_.close();
+    if (msg.msg.data() < msg.body.data() ||
+      msg.msg.data() >= msg.body.data() + msg.body.size())
+    {
+      // reassembled from several frames, store it as a single line
+      Json jmsg;
+      jmsg["type"] = "msg";
+      jmsg["user"] = msg.user.to_string();
+      jmsg["msg"] = msg.msg.to_string();
+      jmsg["seq"] = msg.seq;
+      return jmsg.dump();
+    }
+
+    return msg.body.to_string();
   }
 
-private:
-  boost::asio::io_context& io_context_;
-  tcp::socket socket_;
-  std::atomic_bool& connected_;
-  chat_message read_msg_;
-  chat_message_queue write_msgs_;
+  std::string path_;
+  std::ofstream out_;
+  std::deque<std::string> msgs_;
+  std::uint64_t seq_ {0};
+
+  // messages at or below seq_ received since the last login confirmation
+  std::vector<std::pair<std::uint64_t, std::string>> held_;
 };
 
-int main(int argc, char* argv[])
+template<typename Client>
+class chat_shell
 {
-  try
+public:
+
+  // shown from the cache at startup
+  enum { cache_lines = 128 };
+
+  chat_shell(boost::asio::io_context& io_context, Client& client,
+    chat_render::options const& render, std::string const& cache_path) :
+    input_ {io_context, client.executor(), ::dup(STDIN_FILENO)},
+    client_ {client},
+    render_ {render}
   {
-    if (argc != 2)
+    if (! cache_path.empty())
     {
-      std::cerr << "Usage: chat_client <port>\n";
-      return 1;
+      // only what is newer than the cache is requested from the server
+      cache_.reset(new chat_cache {cache_path});
+      client_.since(cache_->seq());
     }
 
-    boost::asio::io_context io_context;
+    input_.on_line([this](std::string const& line) { return handle_input(line); });
+    input_.on_chunk([this]()
+      {
+        if (client_.writable())
+        {
+          return true;
+        }
 
-    tcp::resolver resolver(io_context);
-    auto endpoints = resolver.resolve("127.0.0.1", argv[1]);
-    std::atomic_bool connected {true};
-    chat_client client {io_context, connected, endpoints};
+        // wait for the socket to catch up before reading more input
+        client_.on_writable([this]() { input_.resume(); });
+        return false;
+      }
+    );
+    input_.on_end([this]() { client_.close(); });
+
+    // rendering happens on its own thread, the io thread only queues lines
+    client_.on_msg([this](chat_msg_view const& msg)
+      {
+        if (cache_ && msg.seq)
+        {
+          cache_->append(msg);
+        }
 
-    std::thread thread {[&io_context](){ io_context.run(); }};
+        if (msg.id && ! pending_.empty() && msg.user == name_)
+        {
+          bool const shown {pending_.find(msg.id) != pending_.end()};
+          confirm(msg.id);
 
-    std::cout << "Welcome!\n";
+          if (shown)
+          {
+            // already shown when it was sent
+            return;
+          }
+        }
 
-    // main loop
-    std::string input;
-    std::string name;
-    while (connected.load())
-    {
-      if (! std::getline(std::cin, input))
-      {
-        break;
+        // regular message
+        render_.push(msg.user.to_string() + "> " + msg.msg.to_string());
       }
+    );
+    // with acks our own messages never come back, the ack confirms them
+    client_.on_ack([this](std::uint64_t id) { confirm(id); });
 
-      // determine action
-      if (input.empty())
+    client_.on_prv([this](chat_prv_view const& prv)
       {
-        // no input
-        continue;
+        // private message
+        render_.push("[prv]" + prv.from.to_string() + "> " + prv.msg.to_string());
       }
-      else if (input.at(0) == '/')
+    );
+    client_.on_srv([this](chat_srv_view const& srv)
       {
-        // treat input that begins with '/' as special command
-
-        if (input == "/help")
+        if (srv.login)
         {
-          std::cerr
-          << "/help\n"
-          << "  -> display the help output\n"
-          << "/auth <user> <pass>\n"
-          << "  -> login to the server\n"
-          << "/quit\n"
-          << "  -> close the connection and exit the program\n"
-          << "/priv <user> <regular text here>\n"
-          << "  -> send text as message to single user\n"
-          << "<regular text here>\n"
-          << "  -> send text as message to chat room\n"
-          << "\n";
-          continue;
+          // login confirmed, own messages are echoed locally from now on
+          logged_in_ = true;
         }
-        else if (input == "/quit")
+
+        if (cache_ && srv.login)
         {
-          std::cerr << "Exiting...\n";
-          // exit the program
-          break;
+          // replayed before the confirmation, kept if the server restarted
+          cache_->confirm(srv.seq);
         }
-        else if (input.find("/auth") == 0)
+
+        // one of our room messages was rejected, it was shown as sent
+        auto const it = srv.id ? pending_.find(srv.id) : pending_.end();
+        if (it != pending_.end())
         {
-          // format : '/auth <name> <password>'
+          render_.push("server> " + srv.str.to_string() + ", not sent: " + it->second);
+          pending_.erase(it);
+          return;
+        }
 
-          auto pos_user = input.find_first_of(" ") + 1;
-          if (pos_user == std::string::npos)
+        // server message
+        render_.push("server> " + srv.str.to_string());
+      }
+    );
+    client_.on_disconnect([](std::size_t delay)
+      {
+        std::cerr << "Error: connection lost, reconnecting in " << delay << "ms\n";
+      }
+    );
+    client_.on_close([this]()
+      {
+        // the client gave up, what the server never confirmed is lost
+        for (auto const id : pending_ids_)
+        {
+          auto const it = pending_.find(id);
+          if (it != pending_.end())
           {
-            std::cerr << "Error: incorrect <name> <password> format\n";
-            continue;
+            render_.push("server> Error: connection closed, not sent: " + it->second);
           }
+        }
+        pending_.clear();
+        pending_ids_.clear();
 
-          auto pos_pass = input.substr(pos_user).find_first_of(" ") + pos_user + 1;
-          if (pos_pass == std::string::npos)
-          {
-            std::cerr << "Error: incorrect <name> <password> format\n";
-            continue;
-          }
+        input_.close();
+      }
+    );
+  }
 
-          // set the users name
-          name = input.substr(pos_user, pos_pass - pos_user - 1);
+  void start()
+  {
+    render_.push("Welcome!");
 
-          // send user and pass
-          // build up json body message
-          Json jreq;
-          jreq["type"] = "auth";
-          jreq["user"] = name;
-          jreq["pass"] = input.substr(pos_pass);
-          std::string req {jreq.dump()};
+    if (cache_)
+    {
+      auto const& msgs = cache_->msgs();
+      auto const count = std::min<std::size_t>(msgs.size(), cache_lines);
+      for (auto it = msgs.end() - static_cast<std::ptrdiff_t>(count); it != msgs.end(); ++it)
+      {
+        render_.push(*it);
+      }
+    }
 
-          // check length of req string
-          if (req.size() > chat_message::max_body_length)
-          {
-            std::cerr << "Error: message length too long\n";
-            continue;
-          }
+    input_.start();
+  }
 
-          // send the message
-          chat_message msg {req};
-          client.write(msg);
-          continue;
-        }
-        else if (input.find("/priv") == 0)
-        {
-          // /priv <user> <regular text here>
-          // send private message to another user
+private:
+
+  // returns false when the program should exit
+  bool handle_input(std::string const& input)
+  {
+    // determine action
+    if (input.empty())
+    {
+      // no input
+      return true;
+    }
+    else if (input.at(0) == '/')
+    {
+      // treat input that begins with '/' as special command
+
+      if (input == "/help")
+      {
+        std::cerr
+        << "/help\n"
+        << "  -> display the help output\n"
+        << "/auth <user> <pass>\n"
+        << "  -> login to the server\n"
+        << "/quit\n"
+        << "  -> close the connection and exit the program\n"
+        << "/priv <user> <regular text here>\n"
+        << "  -> send text as message to single user\n"
+        << "/stats [json]\n"
+        << "  -> display round trip and delivery latency percentiles\n"
+        << "/sub [mentions] [@user ...] [word ...]\n"
+        << "  -> only receive room messages that mention you, come from the\n"
+        << "     users or contain the words, no arguments receives everything\n"
+        << "<regular text here>\n"
+        << "  -> send text as message to chat room\n"
+        << "\n";
+        return true;
+      }
+      else if (input == "/stats")
+      {
+        auto const& stats = client_.stats();
+        render_.push(format_stats("rtt", stats.rtt));
+        render_.push(format_stats("e2e", stats.e2e));
+        return true;
+      }
+      else if (input == "/stats json")
+      {
+        render_.push(client_.stats().to_json().dump());
+        return true;
+      }
+      else if (input == "/quit")
+      {
+        std::cerr << "Exiting...\n";
+        // exit the program
+        return false;
+      }
+      else if (input == "/sub" || input.find("/sub ") == 0)
+      {
+        // /sub [mentions] [@user ...] [word ...]
+        bool mentions {false};
+        std::string from;
+        std::string words;
 
-          auto pos_user = input.find_first_of(" ") + 1;
-          if (pos_user == std::string::npos)
+        std::istringstream args {input.substr(4)};
+        std::string arg;
+        while (args >> arg)
+        {
+          if (arg == "mentions")
           {
-            std::cerr << "Error: incorrect <name> <password> format\n";
-            continue;
+            mentions = true;
           }
-
-          auto pos_msg = input.substr(pos_user).find_first_of(" ") + pos_user + 1;
-          if (pos_msg == std::string::npos)
+          else if (arg.size() > 1 && arg[0] == '@')
           {
-            std::cerr << "Error: incorrect <name> <password> format\n";
-            continue;
+            from += (from.empty() ? "" : ",") + arg.substr(1);
           }
-
-          // build up json body message
-          Json jreq;
-          jreq["type"] = "prv";
-          jreq["user"] = name;
-          jreq["to"] = input.substr(pos_user, pos_msg - pos_user - 1);
-          jreq["msg"] = input.substr(pos_msg);
-          std::string req {jreq.dump()};
-
-          // check length of req string
-          if (req.size() > chat_message::max_body_length)
+          else
           {
-            std::cerr << "Error: message length too long\n";
-            continue;
+            words += (words.empty() ? "" : ",") + arg;
           }
-
-          // send the message
-          chat_message msg {req};
-          client.write(msg);
         }
-        // else if (input == "")
-        // {
-        //   // do something
-        // }
-        else
+
+        if (! client_.subscribe(mentions, from, words))
         {
-          // unknown command
-          std::cerr << "Error: unknown command '" << input << "'\n";
-          continue;
+          std::cerr << "Error: message length too long\n";
         }
+        return true;
       }
-      else
+      else if (input.find("/auth") == 0)
       {
-        // send message
+        // format : '/auth <name> <password>'
+
+        auto pos_user = input.find_first_of(" ") + 1;
+        if (pos_user == std::string::npos)
+        {
+          std::cerr << "Error: incorrect <name> <password> format\n";
+          return true;
+        }
 
-        // build up json body message
-        Json jreq;
-        jreq["type"] = "msg";
-        jreq["user"] = name;
-        jreq["msg"] = input;
-        std::string req {jreq.dump()};
+        auto pos_pass = input.substr(pos_user).find_first_of(" ") + pos_user + 1;
+        if (pos_pass == std::string::npos)
+        {
+          std::cerr << "Error: incorrect <name> <password> format\n";
+          return true;
+        }
 
-        // check length of req string
-        if (req.size() > chat_message::max_body_length)
+        // set the users name
+        name_ = input.substr(pos_user, pos_pass - pos_user - 1);
+
+        // send user and pass, the client logs in again after a reconnect
+        if (! client_.login(name_, input.substr(pos_pass)))
         {
           std::cerr << "Error: message length too long\n";
-          continue;
         }
+        return true;
+      }
+      else if (input.find("/priv") == 0)
+      {
+        // /priv <user> <regular text here>
+        // send private message to another user
+
+        auto pos_user = input.find_first_of(" ") + 1;
+        if (pos_user == std::string::npos)
+        {
+          std::cerr << "Error: incorrect <name> <password> format\n";
+          return true;
+        }
+
+        auto pos_msg = input.substr(pos_user).find_first_of(" ") + pos_user + 1;
+        if (pos_msg == std::string::npos)
+        {
+          std::cerr << "Error: incorrect <name> <password> format\n";
+          return true;
+        }
+
+        if (! chat_utf8_valid(input.data(), input.size()))
+        {
+          std::cerr << "Error: message is not valid utf-8\n";
+          return true;
+        }
+
+        if (! client_.prv(input.substr(pos_user, pos_msg - pos_user - 1),
+          input.substr(pos_msg)))
+        {
+          std::cerr << "Error: message length too long\n";
+        }
+        return true;
+      }
+      // else if (input == "")
+      // {
+      //   // do something
+      // }
+      else
+      {
+        // unknown command
+        std::cerr << "Error: unknown command '" << input << "'\n";
+        return true;
+      }
+    }
+    else
+    {
+      // send message, never shown when it cannot be sent
+      if (! chat_utf8_valid(input.data(), input.size()))
+      {
+        std::cerr << "Error: message is not valid utf-8\n";
+        return true;
+      }
+
+      auto const id = client_.msg(input);
+      if (! id)
+      {
+        std::cerr << "Error: message length too long\n";
+        return true;
+      }
+
+      if (logged_in_)
+      {
+        // show it right away, it stays pending until the server echoes it,
+        // and is shown as not sent if the server rejects it
+        pending_.emplace(id, input);
+        pending_ids_.emplace_back(id);
+        render_.push(name_ + "> " + input);
+      }
+      return true;
+    }
+  }
+
+  // the server has handled our room messages up to id, in order, so none
+  // of them is pending any more
+  void confirm(std::uint64_t id)
+  {
+    while (! pending_ids_.empty() && pending_ids_.front() <= id)
+    {
+      pending_.erase(pending_ids_.front());
+      pending_ids_.pop_front();
+    }
+  }
+
+  static std::string format_ms(std::uint64_t us)
+  {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.2fms", static_cast<double>(us) / 1000.0);
+    return buf;
+  }
+
+  static std::string format_stats(std::string const& name, chat_histogram const& hist)
+  {
+    return name + ": count " + std::to_string(hist.count()) +
+      "  min " + format_ms(hist.min()) +
+      "  p50 " + format_ms(hist.percentile(50)) +
+      "  p90 " + format_ms(hist.percentile(90)) +
+      "  p99 " + format_ms(hist.percentile(99)) +
+      "  max " + format_ms(hist.max());
+  }
+
+  chat_input input_;
+  Client& client_;
+  chat_render render_;
+  std::unique_ptr<chat_cache> cache_;
+
+  // messages shown before the server handled them, by client id, and their
+  // ids in the order they were sent, which is the order they are handled in
+  std::unordered_map<std::uint64_t, std::string> pending_;
+  std::deque<std::uint64_t> pending_ids_;
+  bool logged_in_ {false};
+  std::string name_;
+};
+
+class chat_output
+{
+public:
+
+  // start writing without waiting for more data above this size
+  enum { flush_length = 1 << 16 };
+
+  // ask the producer to pause above this size
+  enum { max_length = 1 << 24 };
+
+  // handlers run on the executor of the client the output is fed from
+  chat_output(boost::asio::io_context& io_context,
+    chat_generic_client::executor_type const& executor, int fd) :
+    executor_ {executor},
+    output_ {io_context, fd}
+  {
+    buf_.reserve(flush_length);
+    out_.reserve(flush_length);
+  }
+
+  void write(char const* data, std::size_t length)
+  {
+    buf_.append(data, length);
+    buf_.push_back('\n');
+
+    if (writing_)
+    {
+      return;
+    }
+
+    if (buf_.size() >= flush_length)
+    {
+      do_write();
+    }
+    else if (! flush_posted_)
+    {
+      // collect the rest of the current batch before writing
+      flush_posted_ = true;
+      boost::asio::post(executor_, [this]()
+        {
+          flush_posted_ = false;
+          if (! writing_ && ! buf_.empty())
+          {
+            do_write();
+          }
+        }
+      );
+    }
+  }
+
+  bool full() const
+  {
+    return buf_.size() >= max_length;
+  }
+
+  // called once a full buffer has been written out
+  void on_drain(std::function<void()> handler)
+  {
+    on_drain_ = std::move(handler);
+  }
+
+private:
+
+  void do_write()
+  {
+    writing_ = true;
+    out_.swap(buf_);
+
+    boost::asio::async_write(output_, boost::asio::buffer(out_),
+      boost::asio::bind_executor(executor_,
+      [this](boost::system::error_code ec, std::size_t /*length*/)
+      {
+        writing_ = false;
+        out_.clear();
+
+        if (ec)
+        {
+          buf_.clear();
+          return;
+        }
+
+        if (! buf_.empty())
+        {
+          do_write();
+        }
+
+        if (on_drain_ && ! full())
+        {
+          auto handler = std::move(on_drain_);
+          on_drain_ = nullptr;
+          handler();
+        }
+      })
+    );
+  }
+
+  chat_generic_client::executor_type executor_;
+  boost::asio::posix::stream_descriptor output_;
+  std::string buf_;
+  std::string out_;
+  bool writing_ {false};
+  bool flush_posted_ {false};
+  std::function<void()> on_drain_;
+};
+
+struct chat_batch_options
+{
+  std::size_t window {1024};
+  bool acks {false};
+  std::string user;
+  std::string pass;
+  std::string token;
+  bool lossy {false};
+};
+
+template<typename Client>
+class chat_batch
+{
+public:
+
+  using options = chat_batch_options;
+
+  chat_batch(boost::asio::io_context& io_context, Client& client,
+    int input_fd, options const& opts) :
+    input_ {io_context, client.executor(), input_fd},
+    output_ {io_context, client.executor(), ::dup(STDOUT_FILENO)},
+    client_ {client},
+    opts_ (opts)
+  {
+    client_.watermark(opts_.window);
+
+    input_.on_line([this](std::string const& line) { return handle_line(line); });
+    input_.on_chunk([this]() { return can_send(); });
+    input_.on_end([this]()
+      {
+        input_done_ = true;
+        maybe_close();
+      }
+    );
+
+    client_.on_frame([this](boost::string_view body)
+      {
+        handle_frame(body);
+      }
+    );
+    client_.on_ack([this](std::uint64_t) { retired(); });
+
+    // a rejected room message is done with too, the error itself is
+    // written out with the other frames
+    client_.on_srv([this](chat_srv_view const& srv)
+      {
+        if (srv.id)
+        {
+          retired();
+        }
+      }
+    );
+    client_.on_disconnect([](std::size_t delay)
+      {
+        std::cerr << "Error: connection lost, reconnecting in " << delay << "ms\n";
+      }
+    );
+    client_.on_close([this]() { input_.close(); });
+  }
+
+  void start()
+  {
+    if (! opts_.token.empty())
+    {
+      client_.watch(opts_.token, opts_.lossy);
+    }
+    else if (! opts_.user.empty())
+    {
+      client_.login(opts_.user, opts_.pass);
+    }
+
+    input_.start();
+  }
+
+private:
+
+  // a room message was echoed, acked or rejected, the window has room
+  void retired()
+  {
+    if (input_waiting_ && client_.unacked() < std::max<std::size_t>(1, opts_.window / 2))
+    {
+      input_waiting_ = false;
+      resume_input();
+    }
+
+    maybe_close();
+  }
+
+  bool handle_line(std::string const& line)
+  {
+    if (line.empty())
+    {
+      return true;
+    }
+
+    if (line.at(0) == '{')
+    {
+      // json requests are sent as they are
+      if (! client_.write(line))
+      {
+        std::cerr << "Error: message length too long\n";
+      }
+      return true;
+    }
+
+    if (! chat_utf8_valid(line.data(), line.size()))
+    {
+      std::cerr << "Error: message is not valid utf-8\n";
+      return true;
+    }
+
+    if (! client_.msg(line))
+    {
+      std::cerr << "Error: message length too long\n";
+    }
+
+    return true;
+  }
+
+  // returns true when the input may keep reading, otherwise arranges for it
+  // to resume once the window opens again
+  bool can_send()
+  {
+    if (! client_.writable())
+    {
+      client_.on_writable([this]() { resume_input(); });
+      return false;
+    }
+
+    if (opts_.acks && client_.unacked() >= opts_.window)
+    {
+      input_waiting_ = true;
+      return false;
+    }
+
+    return true;
+  }
+
+  void resume_input()
+  {
+    if (can_send())
+    {
+      input_.resume();
+    }
+  }
+
+  void handle_frame(boost::string_view body)
+  {
+    output_.write(body.data(), body.size());
+
+    if (output_.full())
+    {
+      // stdout can't keep up, let tcp push back on the server
+      client_.pause();
+      output_.on_drain([this]() { client_.resume(); });
+    }
+  }
+
+  void maybe_close()
+  {
+    if (input_done_ && (! opts_.acks || client_.unacked() == 0))
+    {
+      client_.close();
+    }
+  }
+
+  chat_input input_;
+  chat_output output_;
+  Client& client_;
+  options opts_;
+  bool input_waiting_ {false};
+  bool input_done_ {false};
+};
+
+static void usage()
+{
+  std::cerr
+  << "Usage: chat_client [options] <[host:]port|unix:path|shm:path> [...]\n"
+  << "  connects to whichever server answers first, and fails over to the\n"
+  << "  others when the connection drops, host defaults to 127.0.0.1,\n"
+  << "  shm: uses shared memory set up over the unix domain socket at path\n"
+  << "  and can not be mixed with the others\n"
+  << "\n"
+  << "  --batch               read messages or json requests line by line and\n"
+  << "                        write received frames to stdout as json lines,\n"
+  << "                        a server with its flood limits on refuses more\n"
+  << "                        than 100 messages a second or 300 in 10 seconds\n"
+  << "                        from one user, rejected messages are reported\n"
+  << "                        as srv errors, start the server with --no-flood\n"
+  << "                        for bulk loads\n"
+  << "  --input <file>        batch input file, defaults to stdin\n"
+  << "  --window <n>          max messages in flight in batch mode\n"
+  << "  --acks                keep at most --window messages waiting for\n"
+  << "                        their room echo, and wait for all before exiting\n"
+  << "  --no-echo             have the server ack own room messages instead of\n"
+  << "                        echoing them back, the shell still shows them\n"
+  << "                        when sent, batch mode leaves them out\n"
+  << "  --user <user>         authenticate as user in batch mode\n"
+  << "  --pass <pass>         password for --user\n"
+  << "  --watch <token>       join as a read only observer in batch mode\n"
+  << "  --lossy               let the server drop room messages when the\n"
+  << "                        observer falls behind instead of disconnecting\n"
+  << "  --ping <ms>           latency probe interval, 0 disables, defaults to 1000\n"
+  << "  --stats-file <file>   write latency statistics as json on exit\n"
+  << "  --cache <file>        keep received room messages in file, show them at\n"
+  << "                        startup and only fetch newer ones from the server\n"
+  << "  --fps <n>             terminal refresh rate, defaults to 60\n"
+  << "  --max-lines <n>       lines shown per refresh once the terminal falls\n"
+  << "                        behind, 0 shows every line, defaults to 200\n";
+}
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    bool batch {false};
+    std::string input_path;
+    std::vector<std::string> hosts;
+    chat_batch_options opts;
+    chat_render::options render;
+    std::size_t ping {1000};
+    bool echo {true};
+    std::string stats_path;
+    std::string cache_path;
+
+    for (int i = 1; i < argc; ++i)
+    {
+      std::string arg {argv[i]};
+      bool has_value {i + 1 < argc};
+
+      if (arg == "--batch")
+      {
+        batch = true;
+      }
+      else if (arg == "--acks")
+      {
+        opts.acks = true;
+      }
+      else if (arg == "--no-echo")
+      {
+        echo = false;
+      }
+      else if (arg == "--input" && has_value)
+      {
+        input_path = argv[++i];
+      }
+      else if (arg == "--window" && has_value)
+      {
+        opts.window = std::max<std::size_t>(1, std::stoul(argv[++i]));
+      }
+      else if (arg == "--user" && has_value)
+      {
+        opts.user = argv[++i];
+      }
+      else if (arg == "--pass" && has_value)
+      {
+        opts.pass = argv[++i];
+      }
+      else if (arg == "--watch" && has_value)
+      {
+        opts.token = argv[++i];
+      }
+      else if (arg == "--lossy")
+      {
+        opts.lossy = true;
+      }
+      else if (arg == "--ping" && has_value)
+      {
+        ping = std::stoul(argv[++i]);
+      }
+      else if (arg == "--stats-file" && has_value)
+      {
+        stats_path = argv[++i];
+      }
+      else if (arg == "--cache" && has_value)
+      {
+        cache_path = argv[++i];
+      }
+      else if (arg == "--fps" && has_value)
+      {
+        render.fps = std::stoul(argv[++i]);
+      }
+      else if (arg == "--max-lines" && has_value)
+      {
+        render.max_lines = std::stoul(argv[++i]);
+      }
+      else if (arg.at(0) != '-')
+      {
+        hosts.emplace_back(arg);
+      }
+      else
+      {
+        usage();
+        return 1;
+      }
+    }
+
+    if (hosts.empty())
+    {
+      usage();
+      return 1;
+    }
+
+    boost::asio::io_context io_context;
+
+    // the same for every transport, only the client type differs
+    auto const run = [&](auto& client, auto const& endpoints,
+      std::vector<std::string> const& names)
+    {
+      using client_type = typename std::decay<decltype(client)>::type;
+
+      client.ping_interval(std::chrono::milliseconds(ping));
+      client.acks(! echo);
+
+      if (endpoints.size() > 1)
+      {
+        client.on_connect(
+          [&endpoints, &names](typename client_type::endpoint_type const& endpoint,
+            std::size_t us)
+          {
+            auto const it = std::find(endpoints.begin(), endpoints.end(), endpoint);
+            std::cerr << "Connected to " << names.at(static_cast<std::size_t>(
+              it - endpoints.begin())) << " in " << us << "us\n";
+          }
+        );
+      }
+
+      // input is read on the same io_context as the socket
+      if (batch)
+      {
+        int fd {::dup(STDIN_FILENO)};
+        if (! input_path.empty())
+        {
+          fd = ::open(input_path.c_str(), O_RDONLY);
+          if (fd < 0)
+          {
+            std::cerr << "Error: could not open '" << input_path << "'\n";
+            return 1;
+          }
+        }
+
+        chat_batch<client_type> runner {io_context, client, fd, opts};
+        client.connect(endpoints);
+        runner.start();
+        io_context.run();
+      }
+      else
+      {
+        chat_shell<client_type> shell {io_context, client, render, cache_path};
+        client.connect(endpoints);
+        shell.start();
+        io_context.run();
+      }
+
+      if (! stats_path.empty())
+      {
+        std::ofstream file {stats_path};
+        file << client.stats().to_json().dump() << "\n";
+      }
+
+      return 0;
+    };
+
+    // shared memory rings are set up over a unix domain socket, they can not
+    // be raced against the other transports
+    auto const is_shm = [](std::string const& str)
+    {
+      return str.compare(0, 4, "shm:") == 0;
+    };
+
+    if (std::any_of(hosts.begin(), hosts.end(), is_shm))
+    {
+      if (! std::all_of(hosts.begin(), hosts.end(), is_shm))
+      {
+        std::cerr << "Error: shm: can not be mixed with other transports\n";
+        return 1;
+      }
+
+      chat_shm_client::endpoints_type endpoints;
+      for (auto const& str : hosts)
+      {
+        endpoints.emplace_back(str.substr(4));
+      }
+
+      chat_shm_client client {io_context};
+      return run(client, endpoints, hosts);
+    }
+
+    // every address of every host takes part in the connect race
+    tcp::resolver resolver(io_context);
+    chat_generic_client::endpoints_type endpoints;
+    std::vector<std::string> names;
+    for (auto const& str : hosts)
+    {
+      if (str.compare(0, 5, "unix:") == 0)
+      {
+        endpoints.emplace_back(boost::asio::local::stream_protocol::endpoint {str.substr(5)});
+        names.emplace_back(str);
+        continue;
+      }
+
+      std::string host {"127.0.0.1"};
+      std::string port {str};
+
+      auto const pos = str.rfind(':');
+      if (pos != std::string::npos)
+      {
+        host = str.substr(0, pos);
+        port = str.substr(pos + 1);
+
+        // [::1]:port
+        if (host.size() > 1 && host.front() == '[' && host.back() == ']')
+        {
+          host = host.substr(1, host.size() - 2);
+        }
+      }
+
+      for (auto const& entry : resolver.resolve(host, port))
+      {
+        endpoints.emplace_back(entry.endpoint());
 
-        // send the message
-        chat_message msg {req};
-        client.write(msg);
+        std::ostringstream name;
+        name << entry.endpoint();
+        names.emplace_back(name.str());
       }
     }
 
-    client.close();
-    thread.join();
+    chat_generic_client client {io_context};
+    return run(client, endpoints, names);
   }
   catch (std::exception& e)
   {
@@ -86,6 +86,33 @@ public:
     return true;
   }
 
+  // decode a header in place, without copying the frame
+  static bool decode_header(char const* data, std::size_t& length)
+  {
+    std::size_t i {0};
+    while (i < header_length && data[i] == ' ')
+    {
+      ++i;
+    }
+
+    if (i == header_length)
+    {
+      return false;
+    }
+
+    length = 0;
+    for (; i < header_length; ++i)
+    {
+      if (data[i] < '0' || data[i] > '9')
+      {
+        return false;
+      }
+      length = length * 10 + static_cast<std::size_t>(data[i] - '0');
+    }
+
+    return length <= max_body_length;
+  }
+
   void encode_header()
   {
     char header[header_length + 1] = "";
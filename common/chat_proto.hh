@@ -0,0 +1,1087 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CHAT_PROTO_HPP
+#define CHAT_PROTO_HPP
+
+#include "chat_message.hh"
+#include "chat_text.hh"
+#include "chat_type.hh"
+
+#include <boost/utility/string_view.hpp>
+
+#include <array>
+#include <clocale>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// typed protocol messages
+//
+// each struct names its type code and lists its fields once in fields(),
+// the writer and reader below are generated from that list. strings are
+// views, when writing they must outlive the call, when reading they point
+// into the frame or into the reader and stay valid until the next parse.
+// empty strings and zero numbers are left out of the frame.
+
+// number that is written even when it is zero, as long as it is set
+struct chat_opt
+{
+  chat_opt& operator=(std::uint64_t value_)
+  {
+    value = value_;
+    set = true;
+    return *this;
+  }
+
+  std::uint64_t value {0};
+  bool set {false};
+};
+
+struct chat_auth
+{
+  static constexpr chat_type type {chat_type::auth};
+
+  boost::string_view user;
+  boost::string_view pass;
+
+  // last room message the client has seen
+  std::uint64_t since {0};
+
+  // 1 to get an ack instead of the echo of the client's own room messages
+  std::uint64_t acks {0};
+
+  template<typename Self, typename Visit>
+  static void fields(Self& self, Visit&& visit)
+  {
+    visit("user", self.user);
+    visit("pass", self.pass);
+    visit("since", self.since);
+    visit("acks", self.acks);
+  }
+};
+
+// joins the room as a read only observer, with a token instead of a user
+struct chat_watch
+{
+  static constexpr chat_type type {chat_type::watch};
+
+  boost::string_view token;
+
+  // last room message the observer has seen
+  std::uint64_t since {0};
+
+  // 1 to have the oldest room messages dropped when falling behind, instead
+  // of being disconnected
+  std::uint64_t lossy {0};
+
+  template<typename Self, typename Visit>
+  static void fields(Self& self, Visit&& visit)
+  {
+    visit("token", self.token);
+    visit("since", self.since);
+    visit("lossy", self.lossy);
+  }
+};
+
+struct chat_msg
+{
+  static constexpr chat_type type {chat_type::msg};
+
+  boost::string_view user;
+  boost::string_view msg;
+
+  // client id, echoed back to the sender
+  std::uint64_t id {0};
+
+  // room sequence number, stamped by the server
+  std::uint64_t seq {0};
+
+  // set on the parts of a message too long for one frame
+  std::uint64_t part {0};
+  std::uint64_t parts {0};
+
+  template<typename Self, typename Visit>
+  static void fields(Self& self, Visit&& visit)
+  {
+    visit("user", self.user);
+    visit("msg", self.msg);
+    visit("id", self.id);
+    visit("seq", self.seq);
+    visit("part", self.part);
+    visit("parts", self.parts);
+  }
+};
+
+struct chat_prv
+{
+  static constexpr chat_type type {chat_type::prv};
+
+  // to is set by the sender, from by the server
+  boost::string_view to;
+  boost::string_view from;
+  boost::string_view msg;
+
+  template<typename Self, typename Visit>
+  static void fields(Self& self, Visit&& visit)
+  {
+    visit("to", self.to);
+    visit("from", self.from);
+    visit("msg", self.msg);
+  }
+};
+
+struct chat_srv
+{
+  static constexpr chat_type type {chat_type::srv};
+
+  boost::string_view str;
+
+  // set on the login confirmation, the room's last sequence number
+  chat_opt seq;
+
+  // set on the rejection of a room message, its client id
+  chat_opt id;
+
+  template<typename Self, typename Visit>
+  static void fields(Self& self, Visit&& visit)
+  {
+    visit("str", self.str);
+    visit("seq", self.seq);
+    visit("id", self.id);
+  }
+};
+
+struct chat_ping
+{
+  static constexpr chat_type type {chat_type::ping};
+
+  // sender's clock in microseconds
+  std::uint64_t t {0};
+
+  template<typename Self, typename Visit>
+  static void fields(Self& self, Visit&& visit)
+  {
+    visit("t", self.t);
+  }
+};
+
+struct chat_pong
+{
+  static constexpr chat_type type {chat_type::pong};
+
+  // copied from the ping
+  std::uint64_t t {0};
+
+  template<typename Self, typename Visit>
+  static void fields(Self& self, Visit&& visit)
+  {
+    visit("t", self.t);
+  }
+};
+
+// only the room messages that match are delivered, a mention of the user,
+// a message from one of the users, or one containing one of the words,
+// without any of them every message is delivered
+struct chat_sub
+{
+  static constexpr chat_type type {chat_type::sub};
+
+  // 1 to receive messages that mention the user with @name
+  std::uint64_t mentions {0};
+
+  // comma separated lists
+  boost::string_view from;
+  boost::string_view words;
+
+  template<typename Self, typename Visit>
+  static void fields(Self& self, Visit&& visit)
+  {
+    visit("mentions", self.mentions);
+    visit("from", self.from);
+    visit("words", self.words);
+  }
+};
+
+// sent to the sender of a room message in place of its echo
+struct chat_ack
+{
+  static constexpr chat_type type {chat_type::ack};
+
+  // client id of the message
+  std::uint64_t id {0};
+
+  // room sequence number it was given
+  std::uint64_t seq {0};
+
+  // server time it was sequenced, microseconds since the epoch
+  std::uint64_t ts {0};
+
+  template<typename Self, typename Visit>
+  static void fields(Self& self, Visit&& visit)
+  {
+    visit("id", self.id);
+    visit("seq", self.seq);
+    visit("ts", self.ts);
+  }
+};
+
+// writes json into a fixed buffer, keeps counting past the end so the
+// required length is known even when it does not fit
+class chat_writer
+{
+public:
+
+  chat_writer(char* data, std::size_t capacity) :
+    data_ {data},
+    capacity_ {capacity}
+  {
+  }
+
+  bool ok() const
+  {
+    return size_ <= capacity_;
+  }
+
+  std::size_t size() const
+  {
+    return size_;
+  }
+
+  void put(char c)
+  {
+    if (size_ < capacity_)
+    {
+      data_[size_] = c;
+    }
+    ++size_;
+  }
+
+  void raw(char const* str, std::size_t length)
+  {
+    if (size_ + length <= capacity_)
+    {
+      std::memcpy(data_ + size_, str, length);
+    }
+    size_ += length;
+  }
+
+  void raw(char const* str)
+  {
+    raw(str, std::strlen(str));
+  }
+
+  // quoted and escaped the way nlohmann::json dumps strings
+  void string(boost::string_view str)
+  {
+    static char const hex[] {"0123456789abcdef"};
+
+    put('"');
+
+    std::size_t i {0};
+    for (;;)
+    {
+      // copy the plain run before the next character to escape in one go
+      auto const run = chat_escape_find(str.data() + i, str.size() - i);
+      raw(str.data() + i, run);
+      i += run;
+
+      if (i == str.size())
+      {
+        break;
+      }
+
+      auto const c = static_cast<unsigned char>(str[i++]);
+
+      put('\\');
+      switch (c)
+      {
+        case '"': put('"'); break;
+        case '\\': put('\\'); break;
+        case '\b': put('b'); break;
+        case '\f': put('f'); break;
+        case '\n': put('n'); break;
+        case '\r': put('r'); break;
+        case '\t': put('t'); break;
+        default:
+          raw("u00", 3);
+          put(hex[c >> 4]);
+          put(hex[c & 0x0f]);
+          break;
+      }
+    }
+
+    put('"');
+  }
+
+  void number(std::uint64_t value)
+  {
+    char buf[20];
+    std::size_t i {sizeof(buf)};
+    do
+    {
+      buf[--i] = static_cast<char>('0' + value % 10);
+      value /= 10;
+    }
+    while (value);
+
+    raw(buf + i, sizeof(buf) - i);
+  }
+
+  void key(char const* name)
+  {
+    put(',');
+    put('"');
+    raw(name);
+    put('"');
+    put(':');
+  }
+
+  void field(char const* name, boost::string_view value)
+  {
+    if (! value.empty())
+    {
+      key(name);
+      string(value);
+    }
+  }
+
+  void field(char const* name, std::uint64_t value)
+  {
+    if (value)
+    {
+      key(name);
+      number(value);
+    }
+  }
+
+  void field(char const* name, chat_opt const& value)
+  {
+    if (value.set)
+    {
+      key(name);
+      number(value.value);
+    }
+  }
+
+private:
+
+  char* data_;
+  std::size_t capacity_;
+  std::size_t size_ {0};
+};
+
+template<typename T>
+void chat_put(chat_writer& writer, T const& msg)
+{
+  writer.raw("{\"type\":\"");
+  writer.raw(chat_type_name(T::type));
+  writer.put('"');
+  T::fields(msg, [&writer](char const* name, auto const& value)
+    {
+      writer.field(name, value);
+    }
+  );
+  writer.put('}');
+}
+
+// write a message as a json object, returns its length, or 0 if it does not
+// fit in the buffer
+template<typename T>
+std::size_t chat_write(T const& msg, char* data, std::size_t capacity)
+{
+  chat_writer writer {data, capacity};
+  chat_put(writer, msg);
+
+  return writer.ok() ? writer.size() : 0;
+}
+
+// length of a message once written
+template<typename T>
+std::size_t chat_length(T const& msg)
+{
+  chat_writer writer {nullptr, 0};
+  chat_put(writer, msg);
+
+  return writer.size();
+}
+
+// write a message straight into a frame, returns false if it is too long
+template<typename T>
+bool chat_encode(T const& msg, chat_message& frame)
+{
+  auto const length = chat_write(msg, frame.body(), chat_message::max_body_length);
+  if (! length)
+  {
+    return false;
+  }
+
+  frame.body_length(length);
+  frame.encode_header();
+
+  return true;
+}
+
+// a message as a string, empty if it is longer than a frame body
+template<typename T>
+std::string chat_dump(T const& msg)
+{
+  char buf[chat_message::max_body_length];
+  return {buf, chat_write(msg, buf, sizeof(buf))};
+}
+
+// parses a frame body in a single pass without building a document, the top
+// level members are indexed and read into typed messages on demand.
+// strings without escapes are views into the frame, the others are decoded
+// into the reader's own buffer.
+class chat_reader
+{
+public:
+
+  // members past this are checked but not indexed
+  enum { max_members = 16 };
+
+  // objects and arrays nested deeper than this are refused
+  enum { max_depth = 32 };
+
+  // false if the body is not a single valid json object
+  bool parse(char const* data, std::size_t length)
+  {
+    count_ = 0;
+    scratch_end_ = 0;
+    type_ = chat_type::none;
+
+    if (length > chat_message::max_body_length)
+    {
+      return false;
+    }
+
+    pos_ = data;
+    end_ = data + length;
+
+    skip_space();
+    if (! eat('{'))
+    {
+      return false;
+    }
+
+    skip_space();
+    if (! eat('}'))
+    {
+      for (;;)
+      {
+        member m;
+
+        skip_space();
+        if (! eat('"') || ! read_string(m.key))
+        {
+          return false;
+        }
+
+        skip_space();
+        if (! eat(':'))
+        {
+          return false;
+        }
+
+        skip_space();
+        if (! read_value(m, 0))
+        {
+          return false;
+        }
+
+        if (m.key == "type" && m.kind == kind_string)
+        {
+          type_ = chat_type_code(m.str.data(), m.str.size());
+        }
+
+        if (count_ < max_members)
+        {
+          members_[count_++] = m;
+        }
+
+        skip_space();
+        if (eat('}'))
+        {
+          break;
+        }
+
+        if (! eat(','))
+        {
+          return false;
+        }
+      }
+    }
+
+    skip_space();
+    return pos_ == end_;
+  }
+
+  chat_type type() const
+  {
+    return type_;
+  }
+
+  bool has(boost::string_view key) const
+  {
+    return find(key) != nullptr;
+  }
+
+  // fill a typed message from the parsed members, missing fields and
+  // fields of the wrong kind keep their defaults
+  template<typename T>
+  T get() const
+  {
+    T msg;
+    T::fields(msg, [this](char const* name, auto& value)
+      {
+        auto const m = find(name);
+        if (m)
+        {
+          assign(*m, value);
+        }
+      }
+    );
+
+    return msg;
+  }
+
+private:
+
+  enum kind_type
+  {
+    kind_string,
+    kind_number,
+    kind_other
+  };
+
+  struct member
+  {
+    boost::string_view key;
+    kind_type kind {kind_other};
+    boost::string_view str;
+    std::uint64_t num {0};
+  };
+
+  member const* find(boost::string_view key) const
+  {
+    for (std::size_t i = 0; i < count_; ++i)
+    {
+      if (members_[i].key == key)
+      {
+        return &members_[i];
+      }
+    }
+
+    return nullptr;
+  }
+
+  static void assign(member const& m, boost::string_view& value)
+  {
+    if (m.kind == kind_string)
+    {
+      value = m.str;
+    }
+  }
+
+  static void assign(member const& m, std::uint64_t& value)
+  {
+    if (m.kind == kind_number)
+    {
+      value = m.num;
+    }
+  }
+
+  static void assign(member const& m, chat_opt& value)
+  {
+    if (m.kind == kind_number)
+    {
+      value = m.num;
+    }
+  }
+
+  void skip_space()
+  {
+    while (pos_ != end_ && (*pos_ == ' ' || *pos_ == '\t' || *pos_ == '\n' || *pos_ == '\r'))
+    {
+      ++pos_;
+    }
+  }
+
+  bool eat(char c)
+  {
+    if (pos_ != end_ && *pos_ == c)
+    {
+      ++pos_;
+      return true;
+    }
+
+    return false;
+  }
+
+  bool eat(char const* word)
+  {
+    auto const length = std::strlen(word);
+    if (static_cast<std::size_t>(end_ - pos_) >= length && std::memcmp(pos_, word, length) == 0)
+    {
+      pos_ += length;
+      return true;
+    }
+
+    return false;
+  }
+
+  bool read_value(member& m, std::size_t depth)
+  {
+    if (pos_ == end_)
+    {
+      return false;
+    }
+
+    switch (*pos_)
+    {
+      case '"':
+        ++pos_;
+        m.kind = kind_string;
+        return read_string(m.str);
+
+      case '{':
+        m.kind = kind_other;
+        return skip_object(depth + 1);
+
+      case '[':
+        m.kind = kind_other;
+        return skip_array(depth + 1);
+
+      case 't':
+        m.kind = kind_other;
+        return eat("true");
+
+      case 'f':
+        m.kind = kind_other;
+        return eat("false");
+
+      case 'n':
+        m.kind = kind_other;
+        return eat("null");
+
+      default:
+        return read_number(m);
+    }
+  }
+
+  // unsigned integers are read, any other number is only checked
+  bool read_number(member& m)
+  {
+    auto const begin = pos_;
+    bool integer {true};
+
+    if (eat('-'))
+    {
+      integer = false;
+    }
+
+    if (pos_ == end_ || *pos_ < '0' || *pos_ > '9')
+    {
+      return false;
+    }
+
+    // no leading zeros
+    auto const digits = pos_;
+
+    std::uint64_t value {0};
+    while (pos_ != end_ && *pos_ >= '0' && *pos_ <= '9')
+    {
+      auto const digit = static_cast<std::uint64_t>(*pos_ - '0');
+      if (value > (UINT64_MAX - digit) / 10)
+      {
+        integer = false;
+      }
+      value = value * 10 + digit;
+      ++pos_;
+    }
+
+    if (pos_ - digits > 1 && *digits == '0')
+    {
+      return false;
+    }
+
+    if (eat('.'))
+    {
+      integer = false;
+      if (pos_ == end_ || *pos_ < '0' || *pos_ > '9')
+      {
+        return false;
+      }
+      while (pos_ != end_ && *pos_ >= '0' && *pos_ <= '9')
+      {
+        ++pos_;
+      }
+    }
+
+    if (eat('e') || eat('E'))
+    {
+      integer = false;
+      if (! eat('+'))
+      {
+        eat('-');
+      }
+      if (pos_ == end_ || *pos_ < '0' || *pos_ > '9')
+      {
+        return false;
+      }
+      while (pos_ != end_ && *pos_ >= '0' && *pos_ <= '9')
+      {
+        ++pos_;
+      }
+    }
+
+    // refused like nlohmann::json does when it does not fit in a double
+    if (! integer && ! finite(begin, static_cast<std::size_t>(pos_ - begin)))
+    {
+      return false;
+    }
+
+    m.kind = integer ? kind_number : kind_other;
+    m.num = integer ? value : 0;
+
+    return true;
+  }
+
+  // the number is already known to be well formed
+  static bool finite(char const* str, std::size_t length)
+  {
+    // strtod wants a terminated string with the locale's decimal point
+    char buf[chat_message::max_body_length + 1];
+    std::memcpy(buf, str, length);
+    buf[length] = '\0';
+
+    auto const point = std::strchr(buf, '.');
+    if (point)
+    {
+      *point = *std::localeconv()->decimal_point;
+    }
+
+    return std::isfinite(std::strtod(buf, nullptr));
+  }
+
+  // objects and arrays are not indexed, only checked
+  bool skip_object(std::size_t depth)
+  {
+    ++pos_;
+    if (depth > max_depth)
+    {
+      return false;
+    }
+
+    skip_space();
+    if (eat('}'))
+    {
+      return true;
+    }
+
+    for (;;)
+    {
+      boost::string_view key;
+      member m;
+
+      skip_space();
+      if (! eat('"') || ! read_string(key))
+      {
+        return false;
+      }
+
+      skip_space();
+      if (! eat(':'))
+      {
+        return false;
+      }
+
+      skip_space();
+      if (! read_value(m, depth))
+      {
+        return false;
+      }
+
+      skip_space();
+      if (eat('}'))
+      {
+        return true;
+      }
+
+      if (! eat(','))
+      {
+        return false;
+      }
+    }
+  }
+
+  bool skip_array(std::size_t depth)
+  {
+    ++pos_;
+    if (depth > max_depth)
+    {
+      return false;
+    }
+
+    skip_space();
+    if (eat(']'))
+    {
+      return true;
+    }
+
+    for (;;)
+    {
+      member m;
+
+      skip_space();
+      if (! read_value(m, depth))
+      {
+        return false;
+      }
+
+      skip_space();
+      if (eat(']'))
+      {
+        return true;
+      }
+
+      if (! eat(','))
+      {
+        return false;
+      }
+    }
+  }
+
+  // called past the opening quote, strings must be valid utf-8
+  bool read_string(boost::string_view& str)
+  {
+    auto const begin = pos_;
+    pos_ += chat_escape_find(pos_, static_cast<std::size_t>(end_ - pos_));
+
+    if (pos_ == end_ || static_cast<unsigned char>(*pos_) < 0x20)
+    {
+      return false;
+    }
+
+    if (*pos_ == '"')
+    {
+      // the common case, no escapes so the view points into the frame
+      str = {begin, static_cast<std::size_t>(pos_ - begin)};
+      ++pos_;
+      return chat_utf8_valid(str.data(), str.size());
+    }
+
+    // decoding never grows a string, so the scratch buffer, as long as the
+    // largest frame, always has room
+    auto const out = scratch_ + scratch_end_;
+    auto length = static_cast<std::size_t>(pos_ - begin);
+    std::memcpy(out, begin, length);
+
+    while (pos_ != end_ && *pos_ != '"')
+    {
+      if (*pos_ != '\\')
+      {
+        // plain run up to the next quote, backslash or control character
+        auto const run = chat_escape_find(pos_, static_cast<std::size_t>(end_ - pos_));
+        if (! run)
+        {
+          return false;
+        }
+
+        std::memcpy(out + length, pos_, run);
+        length += run;
+        pos_ += run;
+        continue;
+      }
+
+      if (++pos_ == end_)
+      {
+        return false;
+      }
+
+      switch (*pos_++)
+      {
+        case '"': out[length++] = '"'; break;
+        case '\\': out[length++] = '\\'; break;
+        case '/': out[length++] = '/'; break;
+        case 'b': out[length++] = '\b'; break;
+        case 'f': out[length++] = '\f'; break;
+        case 'n': out[length++] = '\n'; break;
+        case 'r': out[length++] = '\r'; break;
+        case 't': out[length++] = '\t'; break;
+        case 'u':
+        {
+          std::uint32_t cp {0};
+          if (! read_hex(cp))
+          {
+            return false;
+          }
+
+          if (cp >= 0xdc00 && cp <= 0xdfff)
+          {
+            return false;
+          }
+
+          if (cp >= 0xd800 && cp <= 0xdbff)
+          {
+            // surrogate pair
+            std::uint32_t low {0};
+            if (! eat('\\') || ! eat('u') || ! read_hex(low) || low < 0xdc00 || low > 0xdfff)
+            {
+              return false;
+            }
+            cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+          }
+
+          length += utf8(cp, out + length);
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+
+    if (pos_ == end_)
+    {
+      return false;
+    }
+
+    ++pos_;
+    str = {out, length};
+    scratch_end_ += length;
+
+    return chat_utf8_valid(str.data(), str.size());
+  }
+
+  bool read_hex(std::uint32_t& value)
+  {
+    if (end_ - pos_ < 4)
+    {
+      return false;
+    }
+
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+      auto const c = *pos_++;
+      value <<= 4;
+      if (c >= '0' && c <= '9')
+      {
+        value |= static_cast<std::uint32_t>(c - '0');
+      }
+      else if (c >= 'a' && c <= 'f')
+      {
+        value |= static_cast<std::uint32_t>(c - 'a' + 10);
+      }
+      else if (c >= 'A' && c <= 'F')
+      {
+        value |= static_cast<std::uint32_t>(c - 'A' + 10);
+      }
+      else
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  static std::size_t utf8(std::uint32_t cp, char* out)
+  {
+    if (cp < 0x80)
+    {
+      out[0] = static_cast<char>(cp);
+      return 1;
+    }
+
+    if (cp < 0x800)
+    {
+      out[0] = static_cast<char>(0xc0 | (cp >> 6));
+      out[1] = static_cast<char>(0x80 | (cp & 0x3f));
+      return 2;
+    }
+
+    if (cp < 0x10000)
+    {
+      out[0] = static_cast<char>(0xe0 | (cp >> 12));
+      out[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+      out[2] = static_cast<char>(0x80 | (cp & 0x3f));
+      return 3;
+    }
+
+    out[0] = static_cast<char>(0xf0 | (cp >> 18));
+    out[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+    out[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+    out[3] = static_cast<char>(0x80 | (cp & 0x3f));
+    return 4;
+  }
+
+  char const* pos_ {nullptr};
+  char const* end_ {nullptr};
+  chat_type type_ {chat_type::none};
+  std::array<member, max_members> members_;
+  std::size_t count_ {0};
+  char scratch_[chat_message::max_body_length];
+  std::size_t scratch_end_ {0};
+};
+
+// the client id of a body the reader refused, from the first "id" key that
+// follows an opening brace or a comma and holds an unsigned integer, 0 if
+// there is none
+inline std::uint64_t chat_salvage_id(boost::string_view body)
+{
+  auto const space = [](char c)
+  {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+  };
+
+  for (auto at = body.find("\"id\""); at != boost::string_view::npos;
+    at = body.find("\"id\"", at + 1))
+  {
+    // a key, not the tail of a string
+    auto before = at;
+    while (before > 0 && space(body[before - 1]))
+    {
+      --before;
+    }
+    if (before == 0 || (body[before - 1] != '{' && body[before - 1] != ','))
+    {
+      continue;
+    }
+
+    auto pos = at + 4;
+    while (pos < body.size() && space(body[pos]))
+    {
+      ++pos;
+    }
+    if (pos == body.size() || body[pos++] != ':')
+    {
+      continue;
+    }
+    while (pos < body.size() && space(body[pos]))
+    {
+      ++pos;
+    }
+
+    std::uint64_t id {0};
+    auto const digits = pos;
+    while (pos < body.size() && body[pos] >= '0' && body[pos] <= '9' && pos - digits < 19)
+    {
+      id = id * 10 + static_cast<std::uint64_t>(body[pos++] - '0');
+    }
+
+    if (pos != digits && (pos == body.size() || body[pos] < '0' || body[pos] > '9'))
+    {
+      return id;
+    }
+  }
+
+  return 0;
+}
+
+#endif // CHAT_PROTO_HPP
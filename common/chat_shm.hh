@@ -0,0 +1,887 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CHAT_SHM_HPP
+#define CHAT_SHM_HPP
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// shared memory transport for clients on the same host
+//
+// a client connects to a unix domain socket, the server answers with a memfd
+// holding two single producer single consumer rings, one per direction, and
+// an eventfd per side, after that frames are copied through the rings. a
+// side only rings the other's eventfd once that side said it is going to
+// sleep, so a pair that keeps each other busy makes no syscalls at all. the
+// unix domain socket stays open, either end closing it ends the connection.
+//
+// chat_shm_protocol plugs into chat_server, chat_session and the client in
+// place of tcp or a unix domain socket.
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+  "the rings need lock free atomics to be shared between processes");
+
+// the shared part of a ring, at the start of its mapping
+struct chat_ring_header
+{
+  // bytes ever written and read, the producer owns head and the consumer tail
+  alignas(64) std::atomic<std::uint64_t> head {0};
+  alignas(64) std::atomic<std::uint64_t> tail {0};
+
+  // set by a side before it sleeps, the other side wakes it after making
+  // progress for it
+  alignas(64) std::atomic<std::uint32_t> reader_waiting {0};
+  std::atomic<std::uint32_t> writer_waiting {0};
+
+  // the producer shut down its side
+  std::atomic<std::uint32_t> closed {0};
+};
+
+// a byte ring over shared memory, the capacity is a power of two
+class chat_ring
+{
+public:
+
+  chat_ring() = default;
+
+  chat_ring(void* base, std::size_t capacity) :
+    header_ {static_cast<chat_ring_header*>(base)},
+    data_ {static_cast<char*>(base) + sizeof(chat_ring_header)},
+    capacity_ {capacity}
+  {
+  }
+
+  // bytes of mapping a ring of capacity bytes takes
+  static std::size_t footprint(std::size_t capacity)
+  {
+    return sizeof(chat_ring_header) + capacity;
+  }
+
+  chat_ring_header& header()
+  {
+    return *header_;
+  }
+
+  // bytes waiting to be read, more than the capacity if the peer scribbled
+  // over the header
+  std::size_t readable() const
+  {
+    return static_cast<std::size_t>(header_->head.load(std::memory_order_acquire) -
+      header_->tail.load(std::memory_order_relaxed));
+  }
+
+  std::size_t writable() const
+  {
+    auto const used = static_cast<std::size_t>(header_->head.load(std::memory_order_relaxed) -
+      header_->tail.load(std::memory_order_acquire));
+    return used > capacity_ ? 0 : capacity_ - used;
+  }
+
+  // copy in as much of the data as fits, returns the bytes written
+  std::size_t write(char const* data, std::size_t size)
+  {
+    auto const head = header_->head.load(std::memory_order_relaxed);
+    auto const n = std::min(size, writable());
+
+    auto const pos = static_cast<std::size_t>(head) & (capacity_ - 1);
+    auto const first = std::min(n, capacity_ - pos);
+    std::memcpy(data_ + pos, data, first);
+    std::memcpy(data_, data + first, n - first);
+
+    header_->head.store(head + n, std::memory_order_release);
+    return n;
+  }
+
+  // copy out up to size bytes, returns the bytes read
+  std::size_t read(char* data, std::size_t size)
+  {
+    auto const tail = header_->tail.load(std::memory_order_relaxed);
+    auto const n = std::min(size, readable());
+
+    auto const pos = static_cast<std::size_t>(tail) & (capacity_ - 1);
+    auto const first = std::min(n, capacity_ - pos);
+    std::memcpy(data, data_ + pos, first);
+    std::memcpy(data + first, data_, n - first);
+
+    header_->tail.store(tail + n, std::memory_order_release);
+    return n;
+  }
+
+  std::size_t capacity() const
+  {
+    return capacity_;
+  }
+
+private:
+
+  chat_ring_header* header_ {nullptr};
+  char* data_ {nullptr};
+  std::size_t capacity_ {0};
+};
+
+// one end of a shared memory connection, shared by the socket handle and
+// the operations waiting on it
+class chat_shm_channel :
+  public std::enable_shared_from_this<chat_shm_channel>
+{
+public:
+
+  using control_type = boost::asio::local::stream_protocol::socket;
+  using executor_type = control_type::executor_type;
+
+  // bytes per ring, each direction has one
+  enum { ring_capacity = 1 << 20 };
+
+  explicit chat_shm_channel(executor_type const& executor) :
+    executor_ {executor},
+    control_ {executor},
+    doorbell_ {executor}
+  {
+  }
+
+  chat_shm_channel(chat_shm_channel const&) = delete;
+  chat_shm_channel& operator=(chat_shm_channel const&) = delete;
+
+  ~chat_shm_channel()
+  {
+    boost::system::error_code ec;
+    close(ec);
+  }
+
+  executor_type get_executor()
+  {
+    return executor_;
+  }
+
+  control_type& control()
+  {
+    return control_;
+  }
+
+  bool is_open() const
+  {
+    return map_ != nullptr;
+  }
+
+  // server side, map the rings and hand them to the client on the control
+  // socket
+  void serve(boost::system::error_code& ec)
+  {
+    auto const length = 2 * chat_ring::footprint(ring_capacity);
+
+    int const memfd {::memfd_create("chat_shm", MFD_CLOEXEC)};
+    int const server_bell {::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)};
+    int const client_bell {::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)};
+
+    if (memfd < 0 || server_bell < 0 || client_bell < 0 ||
+      ::ftruncate(memfd, static_cast<off_t>(length)) != 0 ||
+      ! map(memfd, length, ec))
+    {
+      if (! ec)
+      {
+        ec = last_error();
+      }
+      close_fds({memfd, server_bell, client_bell});
+      return;
+    }
+
+    // ring 0 carries what the server sends, ring 1 what the client sends
+    new (map_) chat_ring_header {};
+    new (static_cast<char*>(map_) + chat_ring::footprint(ring_capacity)) chat_ring_header {};
+    attach(false, ring_capacity);
+
+    std::uint64_t capacity {ring_capacity};
+    int const fds[] {memfd, server_bell, client_bell};
+    if (! send_fds(&capacity, sizeof(capacity), fds, 3))
+    {
+      ec = last_error();
+      close_fds({memfd, server_bell, client_bell});
+      unmap();
+      return;
+    }
+
+    ::close(memfd);
+    doorbell_.assign(server_bell, ec);
+    peer_bell_ = client_bell;
+    watch();
+  }
+
+  // client side, take the rings the server sent on the control socket
+  void join(boost::system::error_code& ec)
+  {
+    std::uint64_t capacity {0};
+    int fds[3] {-1, -1, -1};
+    if (! recv_fds(&capacity, sizeof(capacity), fds, 3))
+    {
+      ec = boost::asio::error::connection_refused;
+      close_fds({fds[0], fds[1], fds[2]});
+      return;
+    }
+
+    struct stat st {};
+    auto const length = 2 * chat_ring::footprint(static_cast<std::size_t>(capacity));
+    if (capacity == 0 || (capacity & (capacity - 1)) || ::fstat(fds[0], &st) != 0 ||
+      static_cast<std::size_t>(st.st_size) < length || ! map(fds[0], length, ec))
+    {
+      if (! ec)
+      {
+        ec = boost::asio::error::connection_refused;
+      }
+      close_fds({fds[0], fds[1], fds[2]});
+      return;
+    }
+
+    attach(true, static_cast<std::size_t>(capacity));
+
+    ::close(fds[0]);
+    doorbell_.assign(fds[2], ec);
+    peer_bell_ = fds[1];
+    watch();
+  }
+
+  // shut down the sending side, the peer reads the end of the stream once
+  // it has read everything before it
+  void shutdown_send()
+  {
+    if (map_)
+    {
+      tx_.header().closed.store(1);
+      wake_reader();
+    }
+  }
+
+  void close(boost::system::error_code& ec)
+  {
+    ec = {};
+
+    if (map_)
+    {
+      shutdown_send();
+      unmap();
+    }
+
+    fail(boost::asio::error::operation_aborted);
+
+    boost::system::error_code ignored;
+    doorbell_.close(ignored);
+    control_.close(ignored);
+
+    if (peer_bell_ >= 0)
+    {
+      ::close(peer_bell_);
+      peer_bell_ = -1;
+    }
+  }
+
+  template<typename Buffers, typename Handler>
+  void async_read_some(Buffers const& buffers, Handler&& handler)
+  {
+    start(read_op_, std::make_unique<operation<Buffers, typename std::decay<Handler>::type, true>>(
+      buffers, std::forward<Handler>(handler)));
+  }
+
+  template<typename Buffers, typename Handler>
+  void async_write_some(Buffers const& buffers, Handler&& handler)
+  {
+    start(write_op_, std::make_unique<operation<Buffers, typename std::decay<Handler>::type, false>>(
+      buffers, std::forward<Handler>(handler)));
+  }
+
+private:
+
+  // a read or write waiting for the peer
+  struct pending
+  {
+    virtual ~pending() {}
+
+    // try again, true once the operation has completed
+    virtual bool perform(chat_shm_channel& channel) = 0;
+    virtual void complete(chat_shm_channel& channel, boost::system::error_code ec) = 0;
+  };
+
+  template<typename Buffers, typename Handler, bool Read>
+  struct operation : pending
+  {
+    template<typename H>
+    operation(Buffers const& buffers_, H&& handler_) :
+      buffers {buffers_},
+      handler {std::forward<H>(handler_)}
+    {
+    }
+
+    bool perform(chat_shm_channel& channel) override
+    {
+      boost::system::error_code ec;
+      auto const n = transfer(channel, ec, std::integral_constant<bool, Read> {});
+      if (! n && ! ec && boost::asio::buffer_size(buffers))
+      {
+        return false;
+      }
+
+      post(channel, ec, n);
+      return true;
+    }
+
+    void complete(chat_shm_channel& channel, boost::system::error_code ec) override
+    {
+      post(channel, ec, 0);
+    }
+
+    std::size_t transfer(chat_shm_channel& channel, boost::system::error_code& ec, std::true_type)
+    {
+      return channel.read_some(buffers, ec);
+    }
+
+    std::size_t transfer(chat_shm_channel& channel, boost::system::error_code& ec, std::false_type)
+    {
+      return channel.write_some(buffers, ec);
+    }
+
+    // never called from within the initiating function
+    void post(chat_shm_channel& channel, boost::system::error_code ec, std::size_t n)
+    {
+      auto const executor = boost::asio::get_associated_executor(handler, channel.executor_);
+      boost::asio::post(executor,
+        [handler = std::move(handler), ec, n]() mutable
+        {
+          handler(ec, n);
+        }
+      );
+    }
+
+    Buffers buffers;
+    Handler handler;
+  };
+
+  static boost::system::error_code last_error()
+  {
+    return {errno, boost::system::system_category()};
+  }
+
+  static void close_fds(std::initializer_list<int> fds)
+  {
+    for (auto const fd : fds)
+    {
+      if (fd >= 0)
+      {
+        ::close(fd);
+      }
+    }
+  }
+
+  bool map(int fd, std::size_t length, boost::system::error_code& ec)
+  {
+    auto const base = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+      ec = last_error();
+      return false;
+    }
+
+    map_ = base;
+    map_length_ = length;
+    return true;
+  }
+
+  void unmap()
+  {
+    ::munmap(map_, map_length_);
+    map_ = nullptr;
+    map_length_ = 0;
+    rx_ = chat_ring {};
+    tx_ = chat_ring {};
+  }
+
+  void attach(bool client, std::size_t capacity)
+  {
+    chat_ring const first {map_, capacity};
+    chat_ring const second {static_cast<char*>(map_) + chat_ring::footprint(capacity), capacity};
+    rx_ = client ? first : second;
+    tx_ = client ? second : first;
+  }
+
+  bool send_fds(void const* data, std::size_t size, int const* fds, std::size_t count)
+  {
+    iovec iov {const_cast<void*>(data), size};
+    char control[CMSG_SPACE(sizeof(int) * 3)] {};
+
+    msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+    auto const cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+
+    return ::sendmsg(control_.native_handle(), &msg, MSG_NOSIGNAL) ==
+      static_cast<ssize_t>(size);
+  }
+
+  bool recv_fds(void* data, std::size_t size, int* fds, std::size_t count)
+  {
+    iovec iov {data, size};
+    char control[CMSG_SPACE(sizeof(int) * 3)] {};
+
+    msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+    auto const n = ::recvmsg(control_.native_handle(), &msg, MSG_CMSG_CLOEXEC);
+    auto const cmsg = CMSG_FIRSTHDR(&msg);
+    if (n != static_cast<ssize_t>(size) || ! cmsg || cmsg->cmsg_type != SCM_RIGHTS)
+    {
+      return false;
+    }
+
+    auto const received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    std::memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * std::min(received, count));
+    return received == count;
+  }
+
+  // the control socket carries nothing after the handshake, it turning
+  // readable means the peer is gone. the wait can complete with nothing to
+  // read, which is only a spurious wakeup, so look before giving up on it.
+  void watch()
+  {
+    control_.async_wait(control_type::wait_read,
+      [self = shared_from_this()](boost::system::error_code ec)
+      {
+        if (ec == boost::asio::error::operation_aborted)
+        {
+          return;
+        }
+
+        char peek {0};
+        if (! ec && ::recv(self->control_.native_handle(), &peek, 1,
+          MSG_PEEK | MSG_DONTWAIT) < 0 && errno == EAGAIN)
+        {
+          self->watch();
+          return;
+        }
+
+        self->peer_gone_ = true;
+        self->progress();
+      }
+    );
+  }
+
+  template<typename Buffers>
+  std::size_t read_some(Buffers const& buffers, boost::system::error_code& ec)
+  {
+    if (! map_)
+    {
+      ec = boost::asio::error::bad_descriptor;
+      return 0;
+    }
+
+    if (rx_.readable() > rx_.capacity())
+    {
+      ec = boost::asio::error::invalid_argument;
+      return 0;
+    }
+
+    std::size_t n {0};
+    for (auto it = boost::asio::buffer_sequence_begin(buffers);
+      it != boost::asio::buffer_sequence_end(buffers); ++it)
+    {
+      boost::asio::mutable_buffer const buffer {*it};
+      auto const got = rx_.read(static_cast<char*>(buffer.data()), buffer.size());
+      n += got;
+      if (got < buffer.size())
+      {
+        break;
+      }
+    }
+
+    if (n)
+    {
+      wake_writer();
+    }
+    else if (rx_.header().closed.load() && ! rx_.readable())
+    {
+      ec = boost::asio::error::eof;
+    }
+    else if (peer_gone_)
+    {
+      ec = boost::asio::error::connection_reset;
+    }
+
+    return n;
+  }
+
+  template<typename Buffers>
+  std::size_t write_some(Buffers const& buffers, boost::system::error_code& ec)
+  {
+    if (! map_)
+    {
+      ec = boost::asio::error::bad_descriptor;
+      return 0;
+    }
+
+    if (tx_.header().closed.load() || peer_gone_)
+    {
+      ec = boost::asio::error::broken_pipe;
+      return 0;
+    }
+
+    std::size_t n {0};
+    for (auto it = boost::asio::buffer_sequence_begin(buffers);
+      it != boost::asio::buffer_sequence_end(buffers); ++it)
+    {
+      boost::asio::const_buffer const buffer {*it};
+      auto const put = tx_.write(static_cast<char const*>(buffer.data()), buffer.size());
+      n += put;
+      if (put < buffer.size())
+      {
+        break;
+      }
+    }
+
+    if (n)
+    {
+      wake_reader();
+    }
+
+    return n;
+  }
+
+  void ring()
+  {
+    std::uint64_t const one {1};
+    auto const n = ::write(peer_bell_, &one, sizeof(one));
+    static_cast<void>(n);
+  }
+
+  // only a peer that said it is going to sleep needs waking
+  void wake_reader()
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (tx_.header().reader_waiting.load() && tx_.header().reader_waiting.exchange(0))
+    {
+      ring();
+    }
+  }
+
+  void wake_writer()
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (rx_.header().writer_waiting.load() && rx_.header().writer_waiting.exchange(0))
+    {
+      ring();
+    }
+  }
+
+  void start(std::unique_ptr<pending>& slot, std::unique_ptr<pending> op)
+  {
+    if (slot)
+    {
+      op->complete(*this, boost::asio::error::in_progress);
+      return;
+    }
+
+    slot = std::move(op);
+    progress();
+  }
+
+  void fail(boost::system::error_code ec)
+  {
+    if (read_op_)
+    {
+      read_op_->complete(*this, ec);
+      read_op_.reset();
+    }
+
+    if (write_op_)
+    {
+      write_op_->complete(*this, ec);
+      write_op_.reset();
+    }
+  }
+
+  // run the waiting operations, and sleep on the doorbell if they still
+  // can't make progress
+  void progress()
+  {
+    for (;;)
+    {
+      if (read_op_ && read_op_->perform(*this))
+      {
+        read_op_.reset();
+      }
+
+      if (write_op_ && write_op_->perform(*this))
+      {
+        write_op_.reset();
+      }
+
+      if ((! read_op_ && ! write_op_) || ! map_)
+      {
+        return;
+      }
+
+      // say we are going to sleep, then look once more, so progress the
+      // peer made before seeing the flag isn't missed
+      if (read_op_)
+      {
+        rx_.header().reader_waiting.store(1);
+      }
+
+      if (write_op_)
+      {
+        tx_.header().writer_waiting.store(1);
+      }
+
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+      bool const readable {read_op_ && (rx_.readable() || rx_.header().closed.load())};
+      bool const writable {write_op_ && tx_.writable()};
+      if (! readable && ! writable)
+      {
+        break;
+      }
+    }
+
+    if (waiting_)
+    {
+      return;
+    }
+
+    waiting_ = true;
+    doorbell_.async_read_some(boost::asio::buffer(&bell_, sizeof(bell_)),
+      [self = shared_from_this()](boost::system::error_code ec, std::size_t /*length*/)
+      {
+        self->waiting_ = false;
+        if (ec)
+        {
+          return;
+        }
+
+        self->progress();
+      }
+    );
+  }
+
+  executor_type executor_;
+  control_type control_;
+  boost::asio::posix::stream_descriptor doorbell_;
+  int peer_bell_ {-1};
+  std::uint64_t bell_ {0};
+  bool waiting_ {false};
+  bool peer_gone_ {false};
+  void* map_ {nullptr};
+  std::size_t map_length_ {0};
+  chat_ring rx_;
+  chat_ring tx_;
+  std::unique_ptr<pending> read_op_;
+  std::unique_ptr<pending> write_op_;
+};
+
+// the stream over a shared memory connection, used like a socket
+class chat_shm_socket :
+  public boost::asio::socket_base
+{
+public:
+
+  using executor_type = chat_shm_channel::executor_type;
+  using endpoint_type = boost::asio::local::stream_protocol::endpoint;
+
+  explicit chat_shm_socket(executor_type const& executor) :
+    executor_ {executor},
+    channel_ {std::make_shared<chat_shm_channel>(executor)}
+  {
+  }
+
+  explicit chat_shm_socket(boost::asio::io_context& io_context) :
+    chat_shm_socket {executor_type {io_context.get_executor()}}
+  {
+  }
+
+  // the executor is copied, a moved from socket keeps its own
+  chat_shm_socket(chat_shm_socket&& other) :
+    executor_ {other.executor_},
+    channel_ {std::move(other.channel_)}
+  {
+  }
+
+  chat_shm_socket& operator=(chat_shm_socket&& other)
+  {
+    if (this != &other)
+    {
+      boost::system::error_code ec;
+      close(ec);
+      executor_ = other.executor_;
+      channel_ = std::move(other.channel_);
+    }
+
+    return *this;
+  }
+
+  // like a socket, destroying it closes the connection
+  ~chat_shm_socket()
+  {
+    boost::system::error_code ec;
+    close(ec);
+  }
+
+  // kept here as well, a moved from socket has no channel but is still
+  // asked for its executor
+  executor_type get_executor()
+  {
+    return executor_;
+  }
+
+  bool is_open() const
+  {
+    return channel_ && channel_->is_open();
+  }
+
+  // connect the control socket and take the rings the server hands over
+  template<typename Handler>
+  void async_connect(endpoint_type const& endpoint, Handler&& handler)
+  {
+    auto const executor = boost::asio::get_associated_executor(handler, get_executor());
+    auto channel = channel_;
+
+    channel->control().async_connect(endpoint, boost::asio::bind_executor(executor,
+      [channel, executor, handler = std::forward<Handler>(handler)](
+        boost::system::error_code ec) mutable
+      {
+        if (ec)
+        {
+          handler(ec);
+          return;
+        }
+
+        channel->control().async_wait(chat_shm_channel::control_type::wait_read,
+          boost::asio::bind_executor(executor,
+            [channel, handler = std::move(handler)](boost::system::error_code wait_ec) mutable
+            {
+              if (! wait_ec)
+              {
+                channel->join(wait_ec);
+              }
+
+              handler(wait_ec);
+            }
+          )
+        );
+      }
+    ));
+  }
+
+  template<typename Buffers, typename Handler>
+  void async_read_some(Buffers const& buffers, Handler&& handler)
+  {
+    channel_->async_read_some(buffers, std::forward<Handler>(handler));
+  }
+
+  template<typename Buffers, typename Handler>
+  void async_write_some(Buffers const& buffers, Handler&& handler)
+  {
+    channel_->async_write_some(buffers, std::forward<Handler>(handler));
+  }
+
+  void shutdown(shutdown_type what, boost::system::error_code& ec)
+  {
+    if (! channel_)
+    {
+      ec = boost::asio::error::bad_descriptor;
+      return;
+    }
+
+    ec = {};
+    if (what != shutdown_receive)
+    {
+      channel_->shutdown_send();
+    }
+  }
+
+  void close(boost::system::error_code& ec)
+  {
+    if (channel_)
+    {
+      channel_->close(ec);
+    }
+  }
+
+private:
+
+  friend class chat_shm_acceptor;
+
+  executor_type executor_;
+  std::shared_ptr<chat_shm_channel> channel_;
+};
+
+// accepts unix domain socket connections and hands each a pair of rings
+class chat_shm_acceptor
+{
+public:
+
+  using endpoint_type = boost::asio::local::stream_protocol::endpoint;
+
+  chat_shm_acceptor(boost::asio::io_context& io_context, endpoint_type const& endpoint) :
+    io_context_ {io_context},
+    acceptor_ {io_context, endpoint}
+  {
+  }
+
+  template<typename Handler>
+  void async_accept(Handler&& handler)
+  {
+    acceptor_.async_accept(
+      [this, handler = std::forward<Handler>(handler)](boost::system::error_code ec,
+        chat_shm_channel::control_type control) mutable
+      {
+        chat_shm_socket socket {io_context_};
+        if (! ec)
+        {
+          socket.channel_->control() = std::move(control);
+          socket.channel_->serve(ec);
+        }
+
+        handler(ec, std::move(socket));
+      }
+    );
+  }
+
+private:
+
+  boost::asio::io_context& io_context_;
+  boost::asio::local::stream_protocol::acceptor acceptor_;
+};
+
+// the shared memory transport, for chat_server and the client
+struct chat_shm_protocol
+{
+  using endpoint = boost::asio::local::stream_protocol::endpoint;
+  using socket = chat_shm_socket;
+  using acceptor = chat_shm_acceptor;
+};
+
+#endif // CHAT_SHM_HPP
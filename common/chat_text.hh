@@ -0,0 +1,215 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CHAT_TEXT_HPP
+#define CHAT_TEXT_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// text scanning for message bodies
+//
+// the loops take 32 bytes at a time with avx2 or 16 with sse2, whichever the
+// build enables, and fall back to a byte at a time elsewhere and for the
+// tail. only the common case is vectorized, plain ascii and runs of bytes
+// that need no escaping, anything else is handled by the scalar code.
+
+namespace chat_text_detail
+{
+
+// length of the valid utf-8 sequence at data, 0 if it is not one
+inline std::size_t utf8_sequence(unsigned char const* data, std::size_t length)
+{
+  auto const c = data[0];
+  if (c < 0x80)
+  {
+    return 1;
+  }
+
+  // bounds of the second byte, the others are always 0x80 to 0xbf
+  std::size_t size {0};
+  unsigned char lo {0x80};
+  unsigned char hi {0xbf};
+
+  if (c >= 0xc2 && c <= 0xdf)
+  {
+    size = 2;
+  }
+  else if (c >= 0xe0 && c <= 0xef)
+  {
+    size = 3;
+
+    // no overlong forms and no surrogates
+    if (c == 0xe0)
+    {
+      lo = 0xa0;
+    }
+    else if (c == 0xed)
+    {
+      hi = 0x9f;
+    }
+  }
+  else if (c >= 0xf0 && c <= 0xf4)
+  {
+    size = 4;
+
+    // no overlong forms and nothing past U+10FFFF
+    if (c == 0xf0)
+    {
+      lo = 0x90;
+    }
+    else if (c == 0xf4)
+    {
+      hi = 0x8f;
+    }
+  }
+  else
+  {
+    return 0;
+  }
+
+  if (length < size || data[1] < lo || data[1] > hi)
+  {
+    return 0;
+  }
+
+  for (std::size_t i = 2; i < size; ++i)
+  {
+    if ((data[i] & 0xc0) != 0x80)
+    {
+      return 0;
+    }
+  }
+
+  return size;
+}
+
+inline bool needs_escape(unsigned char c)
+{
+  return c < 0x20 || c == '"' || c == '\\';
+}
+
+} // namespace chat_text_detail
+
+// true if the bytes are well formed utf-8
+inline bool chat_utf8_valid(char const* data, std::size_t length)
+{
+  auto const str = reinterpret_cast<unsigned char const*>(data);
+  std::size_t i {0};
+
+  while (i < length)
+  {
+#if defined(__AVX2__)
+    // skip ahead over plain ascii
+    while (i + 32 <= length)
+    {
+      auto const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(str + i));
+      auto const mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(v));
+      if (mask)
+      {
+        i += static_cast<std::size_t>(__builtin_ctz(mask));
+        break;
+      }
+      i += 32;
+    }
+#elif defined(__SSE2__)
+    // skip ahead over plain ascii
+    while (i + 16 <= length)
+    {
+      auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(str + i));
+      auto const mask = static_cast<std::uint32_t>(_mm_movemask_epi8(v));
+      if (mask)
+      {
+        i += static_cast<std::size_t>(__builtin_ctz(mask));
+        break;
+      }
+      i += 16;
+    }
+#endif
+
+    if (i == length)
+    {
+      break;
+    }
+
+    auto const size = chat_text_detail::utf8_sequence(str + i, length - i);
+    if (! size)
+    {
+      return false;
+    }
+    i += size;
+  }
+
+  return true;
+}
+
+// offset of the first byte that has to be escaped in a json string, a
+// control character, quote or backslash, or length if there is none
+inline std::size_t chat_escape_find(char const* data, std::size_t length)
+{
+  auto const str = reinterpret_cast<unsigned char const*>(data);
+  std::size_t i {0};
+
+#if defined(__AVX2__)
+  auto const quote = _mm256_set1_epi8('"');
+  auto const slash = _mm256_set1_epi8('\\');
+  auto const ctrl = _mm256_set1_epi8(0x1f);
+
+  while (i + 32 <= length)
+  {
+    auto const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(str + i));
+
+    // unsigned v <= 0x1f is max(v, 0x1f) == 0x1f
+    auto const hit = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, slash)),
+      _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctrl), ctrl));
+
+    auto const mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(hit));
+    if (mask)
+    {
+      return i + static_cast<std::size_t>(__builtin_ctz(mask));
+    }
+    i += 32;
+  }
+#endif
+
+#if defined(__SSE2__)
+  auto const quote16 = _mm_set1_epi8('"');
+  auto const slash16 = _mm_set1_epi8('\\');
+  auto const ctrl16 = _mm_set1_epi8(0x1f);
+
+  while (i + 16 <= length)
+  {
+    auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(str + i));
+
+    auto const hit = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(v, quote16), _mm_cmpeq_epi8(v, slash16)),
+      _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl16), ctrl16));
+
+    auto const mask = static_cast<std::uint32_t>(_mm_movemask_epi8(hit));
+    if (mask)
+    {
+      return i + static_cast<std::size_t>(__builtin_ctz(mask));
+    }
+    i += 16;
+  }
+#endif
+
+  for (; i < length; ++i)
+  {
+    if (chat_text_detail::needs_escape(str[i]))
+    {
+      return i;
+    }
+  }
+
+  return length;
+}
+
+#endif // CHAT_TEXT_HPP
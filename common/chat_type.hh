@@ -0,0 +1,126 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CHAT_TYPE_HPP
+#define CHAT_TYPE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// every message type of the protocol, the value of the json "type" field
+//
+// to add a type, give it a code before count, a name in chat_type_name and a
+// case in chat_type_code, then register a handler for it in the tables that
+// should accept it
+enum class chat_type : std::uint8_t
+{
+  none,
+  auth,
+  msg,
+  prv,
+  srv,
+  ping,
+  pong,
+  sub,
+  ack,
+  watch,
+  count
+};
+
+constexpr std::size_t chat_type_count {static_cast<std::size_t>(chat_type::count)};
+
+inline char const* chat_type_name(chat_type type)
+{
+  switch (type)
+  {
+    case chat_type::auth: return "auth";
+    case chat_type::msg: return "msg";
+    case chat_type::prv: return "prv";
+    case chat_type::srv: return "srv";
+    case chat_type::ping: return "ping";
+    case chat_type::pong: return "pong";
+    case chat_type::sub: return "sub";
+    case chat_type::ack: return "ack";
+    case chat_type::watch: return "watch";
+    default: return "";
+  }
+}
+
+// look up the code of a type name, switching on the length and a character
+// or two leaves at most one string compare
+inline chat_type chat_type_code(char const* str, std::size_t length)
+{
+  auto const is = [&](char const* name)
+  {
+    return std::char_traits<char>::compare(str, name, length) == 0;
+  };
+
+  switch (length)
+  {
+    case 3:
+      switch (str[0])
+      {
+        case 'a': return is("ack") ? chat_type::ack : chat_type::none;
+        case 'm': return is("msg") ? chat_type::msg : chat_type::none;
+        case 'p': return is("prv") ? chat_type::prv : chat_type::none;
+        case 's':
+          switch (str[1])
+          {
+            case 'r': return is("srv") ? chat_type::srv : chat_type::none;
+            case 'u': return is("sub") ? chat_type::sub : chat_type::none;
+            default: return chat_type::none;
+          }
+        default: return chat_type::none;
+      }
+
+    case 4:
+      switch (str[1])
+      {
+        case 'u': return is("auth") ? chat_type::auth : chat_type::none;
+        case 'i': return is("ping") ? chat_type::ping : chat_type::none;
+        case 'o': return is("pong") ? chat_type::pong : chat_type::none;
+        default: return chat_type::none;
+      }
+
+    case 5:
+      return is("watch") ? chat_type::watch : chat_type::none;
+
+    default:
+      return chat_type::none;
+  }
+}
+
+inline chat_type chat_type_code(std::string const& str)
+{
+  return chat_type_code(str.data(), str.size());
+}
+
+// handler table indexed by type code, the lookup is a single array index
+// whatever the number of registered types
+template<typename Handler>
+class chat_dispatch
+{
+public:
+
+  chat_dispatch& on(chat_type type, Handler handler)
+  {
+    handlers_[static_cast<std::size_t>(type)] = handler;
+    return *this;
+  }
+
+  // the registered handler, or a null one for unknown or unregistered types
+  Handler const& operator[](chat_type type) const
+  {
+    return handlers_[static_cast<std::size_t>(type)];
+  }
+
+private:
+
+  std::array<Handler, chat_type_count> handlers_ {};
+};
+
+#endif // CHAT_TYPE_HPP
@@ -0,0 +1,70 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "chat_bench.hh"
+#include "chat_segments.hh"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// the throughput and latency tradeoff of the server's micro-batching, one
+// server per --batch-window, a burst to three readers and spaced messages,
+// with the writes the server needed for the burst
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: batching_bench <server> [messages]\n";
+    return 1;
+  }
+
+  std::size_t const messages {argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 30000};
+  std::size_t const window {512};
+  std::size_t const spaced {200};
+
+  auto const port = chat_test_port(0);
+  chat_client::endpoints_type const endpoints {{boost::asio::ip::address_v4::loopback(), port}};
+
+  std::printf("%zu messages to 3 readers, %zu in flight, then %zu one at a time\n\n",
+    messages, window, spaced);
+  std::printf("%10s %10s %14s %14s %16s %16s\n", "window us", "msgs/s", "server writes",
+    "writes/frame", "burst p50/p99", "spaced p50/p99");
+
+  for (auto const batch_window : {0, 100, 250, 500, 1000, 2000})
+  {
+    chat_test_server server {argv[1], {"--no-flood", "--batch-window",
+      std::to_string(batch_window), std::to_string(static_cast<unsigned>(port))}};
+    if (! server.start(port))
+    {
+      std::cerr << "server did not start\n";
+      return 1;
+    }
+
+    auto const res = chat_bench_run<chat_client>(endpoints, messages, window, spaced,
+      [port]() { return chat_bench_segments(port); });
+    if (! res.ok)
+    {
+      std::cerr << "run with a " << batch_window << "us window did not finish\n";
+      return 1;
+    }
+
+    // every message goes to the sender and the three readers
+    auto const frames = static_cast<double>(messages * 4);
+
+    std::printf("%10d %10.0f %14llu %14.3f %7llu/%-8llu %7llu/%-8llu\n", batch_window, res.rate,
+      static_cast<unsigned long long>(res.server_writes),
+      static_cast<double>(res.server_writes) / frames,
+      static_cast<unsigned long long>(res.burst.percentile(50)),
+      static_cast<unsigned long long>(res.burst.percentile(99)),
+      static_cast<unsigned long long>(res.spaced.percentile(50)),
+      static_cast<unsigned long long>(res.spaced.percentile(99)));
+  }
+
+  return 0;
+}
@@ -0,0 +1,172 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CHAT_BENCH_HPP
+#define CHAT_BENCH_HPP
+
+#include "test/chat_test.hh"
+
+#include "chat_client.hh"
+#include "chat_histogram.hh"
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// shared by the benchmarks, each one starts servers with chat_test_server
+// and drives a sender and three readers of the client library from a single
+// thread. numbers are only worth comparing from a release build.
+
+struct chat_bench_result
+{
+  // room messages a second, once every reader has every message
+  double rate {0};
+
+  // writes of the server during the burst, as counted by the caller, 0
+  // when not counted
+  std::uint64_t server_writes {0};
+
+  // echo latency of the sender in microseconds, during the burst and for
+  // messages sent one at a time
+  chat_histogram burst;
+  chat_histogram spaced;
+
+  bool ok {false};
+};
+
+// a burst of messages with at most window of them waiting on their echo,
+// then spaced messages sent one at a time, from alice to three readers,
+// writes is a running count of the server's writes
+template<typename Client>
+chat_bench_result chat_bench_run(typename Client::endpoints_type const& endpoints,
+  std::size_t messages, std::size_t window, std::size_t spaced,
+  std::function<std::uint64_t()> const& writes = {})
+{
+  using clock = std::chrono::steady_clock;
+
+  chat_bench_result result;
+
+  boost::asio::io_context io_context;
+  Client sender {io_context};
+  std::vector<std::unique_ptr<Client>> readers;
+  for (std::size_t i = 0; i < 3; ++i)
+  {
+    readers.emplace_back(new Client {io_context});
+  }
+
+  std::size_t logins {0};
+  std::size_t sent {0};
+  std::size_t echoed {0};
+  std::size_t done {0};
+  std::vector<std::size_t> received(readers.size(), 0);
+  bool spacing {false};
+  clock::time_point sent_at;
+  clock::time_point finish;
+
+  // the text is about as long as a line of chat
+  auto const send = [&]()
+  {
+    sender.msg("benchmark message " + std::to_string(sent++) + " padded to fill a line");
+  };
+
+  sender.ping_interval(std::chrono::milliseconds(0));
+  sender.on_srv([&](chat_srv_view const& srv) { logins += srv.login; });
+  sender.on_msg([&](chat_msg_view const& msg)
+    {
+      if (msg.user != "alice" || ! msg.id)
+      {
+        return;
+      }
+
+      ++echoed;
+      if (spacing)
+      {
+        result.spaced.record(static_cast<std::uint64_t>(
+          std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - sent_at).count()));
+      }
+      else if (sent < messages)
+      {
+        send();
+      }
+    }
+  );
+
+  char const* const users[][2] {{"rabbit", "verylate"}, {"madhatter", "teaparty"},
+    {"admin", "password"}};
+  for (std::size_t i = 0; i < readers.size(); ++i)
+  {
+    auto& reader = *readers[i];
+    reader.ping_interval(std::chrono::milliseconds(0));
+    reader.on_srv([&](chat_srv_view const& srv) { logins += srv.login; });
+    reader.on_msg([&, i](chat_msg_view const& msg)
+      {
+        if (msg.user == "alice" && ++received[i] == messages && ++done == readers.size())
+        {
+          finish = clock::now();
+        }
+      }
+    );
+    reader.login(users[i][0], users[i][1]);
+    reader.connect(endpoints);
+  }
+
+  sender.login("alice", "hunter2");
+  sender.connect(endpoints);
+
+  if (! chat_test_run(io_context, [&]() { return logins == readers.size() + 1; }))
+  {
+    return result;
+  }
+
+  auto const writes_before = writes ? writes() : 0;
+  auto const start = clock::now();
+  for (std::size_t i = 0; i < window && sent < messages; ++i)
+  {
+    send();
+  }
+
+  if (! chat_test_run(io_context, [&]() { return done == readers.size() && echoed == messages; },
+    std::chrono::seconds(120)))
+  {
+    return result;
+  }
+
+  result.server_writes = writes ? writes() - writes_before : 0;
+  result.rate = static_cast<double>(messages) /
+    std::chrono::duration<double>(finish - start).count();
+  result.burst = sender.stats().e2e;
+
+  spacing = true;
+  for (std::size_t i = 0; i < spaced; ++i)
+  {
+    sent_at = clock::now();
+    send();
+    if (! chat_test_run(io_context, [&]() { return echoed == messages + i + 1; }))
+    {
+      return result;
+    }
+  }
+
+  std::size_t closed {0};
+  sender.on_close([&]() { ++closed; });
+  sender.close();
+  for (auto& reader : readers)
+  {
+    reader->on_close([&]() { ++closed; });
+    reader->close();
+  }
+
+  result.ok = chat_test_run(io_context, [&]() { return closed == readers.size() + 1; });
+
+  return result;
+}
+
+#endif // CHAT_BENCH_HPP
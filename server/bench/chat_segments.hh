@@ -0,0 +1,16 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CHAT_SEGMENTS_HPP
+#define CHAT_SEGMENTS_HPP
+
+#include <cstdint>
+
+// tcp segments with data that this process's sockets connected to port have
+// received so far, over loopback with nagle off that is one per write of the
+// server. in a file of its own, linux/tcp.h clashes with netinet/tcp.h.
+std::uint64_t chat_bench_segments(unsigned short port);
+
+#endif // CHAT_SEGMENTS_HPP
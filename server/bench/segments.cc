@@ -0,0 +1,56 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "chat_segments.hh"
+
+#include <cstdlib>
+
+#include <dirent.h>
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+std::uint64_t chat_bench_segments(unsigned short port)
+{
+  auto const dir = ::opendir("/proc/self/fd");
+  if (! dir)
+  {
+    return 0;
+  }
+
+  std::uint64_t segments {0};
+  while (auto const entry = ::readdir(dir))
+  {
+    auto const fd = std::atoi(entry->d_name);
+
+    sockaddr_storage peer {};
+    socklen_t length {sizeof(peer)};
+    if (::getpeername(fd, reinterpret_cast<sockaddr*>(&peer), &length) != 0)
+    {
+      continue;
+    }
+
+    unsigned short peer_port {0};
+    if (peer.ss_family == AF_INET)
+    {
+      peer_port = ntohs(reinterpret_cast<sockaddr_in const*>(&peer)->sin_port);
+    }
+    else if (peer.ss_family == AF_INET6)
+    {
+      peer_port = ntohs(reinterpret_cast<sockaddr_in6 const*>(&peer)->sin6_port);
+    }
+
+    tcp_info info {};
+    length = sizeof(info);
+    if (peer_port == port && ::getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length) == 0)
+    {
+      segments += info.tcpi_data_segs_in;
+    }
+  }
+
+  ::closedir(dir);
+
+  return segments;
+}
@@ -0,0 +1,149 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "chat_text.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+
+// throughput of the text scanning in chat_text.hh against the scalar code it
+// falls back to, in GB/s, for a short message, a full frame and a long
+// paste, of plain ascii and of text with a multi byte character every 20
+// bytes or so. built once for the default target and once with avx2.
+
+static bool scalar_utf8_valid(char const* data, std::size_t length)
+{
+  auto const str = reinterpret_cast<unsigned char const*>(data);
+  for (std::size_t i = 0; i < length;)
+  {
+    auto const size = chat_text_detail::utf8_sequence(str + i, length - i);
+    if (! size)
+    {
+      return false;
+    }
+    i += size;
+  }
+
+  return true;
+}
+
+static std::size_t scalar_escape_find(char const* data, std::size_t length)
+{
+  auto const str = reinterpret_cast<unsigned char const*>(data);
+  for (std::size_t i = 0; i < length; ++i)
+  {
+    if (chat_text_detail::needs_escape(str[i]))
+    {
+      return i;
+    }
+  }
+
+  return length;
+}
+
+static std::string text(std::size_t length, bool multi_byte)
+{
+  std::mt19937 rng {length};
+  std::uniform_int_distribution<int> ascii {'a', 'z'};
+  std::uniform_int_distribution<int> odds {0, 19};
+
+  std::string str;
+  while (str.size() < length)
+  {
+    if (multi_byte && odds(rng) == 0)
+    {
+      str += "\xc3\xa9";
+    }
+    else
+    {
+      str += static_cast<char>(ascii(rng));
+    }
+  }
+
+  // whole characters only
+  while (str.size() > length)
+  {
+    while ((static_cast<unsigned char>(str.back()) & 0xc0) == 0x80)
+    {
+      str.pop_back();
+    }
+    str.pop_back();
+  }
+
+  return str;
+}
+
+// bytes scanned per nanosecond is GB/s
+template<typename Scan>
+static double measure(std::string const& str, Scan scan)
+{
+  using clock = std::chrono::steady_clock;
+
+  // about 256 MB scanned per measurement
+  auto const rounds = std::max<std::size_t>(1,
+    (std::size_t {1} << 28) / std::max<std::size_t>(1, str.size()));
+
+  volatile std::size_t sink {0};
+  auto const start = clock::now();
+  for (std::size_t i = 0; i < rounds; ++i)
+  {
+    sink = sink + scan(str.data(), str.size());
+  }
+  auto const took = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+
+  return static_cast<double>(str.size() * rounds) /
+    static_cast<double>(std::max<std::int64_t>(1, took.count()));
+}
+
+int main()
+{
+#if defined(__AVX2__)
+  if (! __builtin_cpu_supports("avx2"))
+  {
+    std::printf("no avx2 on this cpu\n");
+    return 1;
+  }
+  std::printf("avx2\n");
+#elif defined(__SSE2__)
+  std::printf("sse2\n");
+#else
+  std::printf("scalar\n");
+#endif
+
+  std::printf("%-8s %8s %12s %12s %12s %12s\n", "text", "bytes",
+    "utf8 GB/s", "scalar", "escape GB/s", "scalar");
+
+  std::size_t const sizes[] {64, 2048, 1 << 20};
+  for (auto const multi_byte : {false, true})
+  {
+    for (auto const size : sizes)
+    {
+      auto const str = text(size, multi_byte);
+
+      auto const utf8 = measure(str, [](char const* data, std::size_t length)
+        {
+          return static_cast<std::size_t>(chat_utf8_valid(data, length));
+        }
+      );
+      auto const utf8_scalar = measure(str, [](char const* data, std::size_t length)
+        {
+          return static_cast<std::size_t>(scalar_utf8_valid(data, length));
+        }
+      );
+      auto const escape = measure(str, chat_escape_find);
+      auto const escape_scalar = measure(str, scalar_escape_find);
+
+      std::printf("%-8s %8zu %12.2f %12.2f %12.2f %12.2f\n", multi_byte ? "utf-8" : "ascii",
+        str.size(), utf8, utf8_scalar, escape, escape_scalar);
+    }
+  }
+
+  return 0;
+}
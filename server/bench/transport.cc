@@ -0,0 +1,89 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "chat_bench.hh"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// throughput and latency of the same burst and spaced messages over each
+// transport the server listens on, tcp, unix domain sockets and shared
+// memory, one server per run
+
+// start a server listening on port and, unless it is tcp only, on listener
+// too, then run the burst over the given endpoints
+template<typename Client>
+static bool run(char const* name, std::string const& binary, unsigned short port,
+  std::string const& listener, typename Client::endpoints_type const& endpoints,
+  std::size_t messages, std::size_t window, std::size_t spaced)
+{
+  std::vector<std::string> args {"--no-flood", std::to_string(static_cast<unsigned>(port))};
+  if (! listener.empty())
+  {
+    args.emplace_back(listener);
+  }
+
+  chat_test_server server {binary, args};
+  if (! server.start(port))
+  {
+    std::cerr << "server did not start\n";
+    return false;
+  }
+
+  auto const res = chat_bench_run<Client>(endpoints, messages, window, spaced);
+  if (! res.ok)
+  {
+    std::cerr << "run over " << name << " did not finish\n";
+    return false;
+  }
+
+  std::printf("%-10s %10.0f %7llu/%-8llu %7llu/%-8llu\n", name, res.rate,
+    static_cast<unsigned long long>(res.burst.percentile(50)),
+    static_cast<unsigned long long>(res.burst.percentile(99)),
+    static_cast<unsigned long long>(res.spaced.percentile(50)),
+    static_cast<unsigned long long>(res.spaced.percentile(99)));
+
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: transport_bench <server> [messages]\n";
+    return 1;
+  }
+
+  std::size_t const messages {argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 30000};
+  std::size_t const window {512};
+  std::size_t const spaced {200};
+
+  auto const port = chat_test_port(0);
+  auto const path = "/tmp/chat_bench." + std::to_string(::getpid());
+  auto const shm_path = "/tmp/chat_bench_shm." + std::to_string(::getpid());
+
+  std::printf("%zu messages to 3 readers, %zu in flight, then %zu one at a time\n\n",
+    messages, window, spaced);
+  std::printf("%-10s %10s %16s %16s\n", "transport", "msgs/s", "burst p50/p99", "spaced p50/p99");
+
+  bool const ok {
+    run<chat_client>("tcp", argv[1], port, {},
+      {{boost::asio::ip::address_v4::loopback(), port}}, messages, window, spaced) &&
+    run<chat_local_client>("unix", argv[1], port, "unix:" + path,
+      {boost::asio::local::stream_protocol::endpoint {path}}, messages, window, spaced) &&
+    run<chat_shm_client>("shm", argv[1], port, "shm:" + shm_path,
+      {chat_shm_protocol::endpoint {shm_path}}, messages, window, spaced)};
+
+  ::unlink(path.c_str());
+  ::unlink(shm_path.c_str());
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CHAT_BITMAP_HPP
+#define CHAT_BITMAP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// growable set of small integers, used for sets of room slots
+class chat_bitmap
+{
+public:
+
+  void set(std::size_t i)
+  {
+    if (i / 64 >= words_.size())
+    {
+      words_.resize(i / 64 + 1, 0);
+    }
+
+    words_[i / 64] |= std::uint64_t {1} << (i % 64);
+  }
+
+  void reset(std::size_t i)
+  {
+    if (i / 64 < words_.size())
+    {
+      words_[i / 64] &= ~(std::uint64_t {1} << (i % 64));
+    }
+  }
+
+  bool test(std::size_t i) const
+  {
+    return i / 64 < words_.size() && (words_[i / 64] >> (i % 64)) & 1;
+  }
+
+  bool none() const
+  {
+    for (auto const w : words_)
+    {
+      if (w)
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  // keeps the allocation, so a scratch bitmap can be reused
+  void assign(chat_bitmap const& other)
+  {
+    words_.assign(other.words_.begin(), other.words_.end());
+  }
+
+  void merge(chat_bitmap const& other)
+  {
+    if (other.words_.size() > words_.size())
+    {
+      words_.resize(other.words_.size(), 0);
+    }
+
+    for (std::size_t i = 0; i < other.words_.size(); ++i)
+    {
+      words_[i] |= other.words_[i];
+    }
+  }
+
+  // returned by for_each once every member has been visited
+  static constexpr std::size_t npos {static_cast<std::size_t>(-1)};
+
+  // call f with up to limit members from from on in increasing order,
+  // returns where to carry on from, or npos once there are none left
+  template<typename F>
+  std::size_t for_each(std::size_t from, std::size_t limit, F&& f) const
+  {
+    for (std::size_t i = from / 64; i < words_.size(); ++i)
+    {
+      auto w = words_[i];
+      if (i == from / 64)
+      {
+        w &= ~std::uint64_t {0} << (from % 64);
+      }
+
+      while (w)
+      {
+        auto const bit = i * 64 + static_cast<std::size_t>(__builtin_ctzll(w));
+        if (! limit--)
+        {
+          return bit;
+        }
+
+        f(bit);
+        w &= w - 1;
+      }
+    }
+
+    return npos;
+  }
+
+  // call f with every member in increasing order
+  template<typename F>
+  void for_each(F&& f) const
+  {
+    for (std::size_t i = 0; i < words_.size(); ++i)
+    {
+      auto w = words_[i];
+      while (w)
+      {
+        f(i * 64 + static_cast<std::size_t>(__builtin_ctzll(w)));
+        w &= w - 1;
+      }
+    }
+  }
+
+private:
+
+  std::vector<std::uint64_t> words_;
+};
+
+#endif // CHAT_BITMAP_HPP
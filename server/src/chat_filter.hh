@@ -0,0 +1,303 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CHAT_FILTER_HPP
+#define CHAT_FILTER_HPP
+
+#include <boost/utility/string_view.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// banned phrase filter
+//
+// the phrases are compiled into an aho-corasick automaton with every
+// transition filled in, so checking a message is one table lookup per byte
+// whatever the number of phrases. matching ignores ascii case.
+//
+// the config file has one phrase per line, preceded by what to do with a
+// message that contains it:
+//
+//   block <phrase>   the message is not sent
+//   mask <phrase>    the phrase is replaced with '*'
+//   flag <phrase>    the message is sent and logged
+//
+// blank lines and lines starting with '#' are ignored.
+class chat_filter
+{
+public:
+
+  // ordered by severity, a message gets the most severe of its matches
+  enum class action : std::uint8_t
+  {
+    none,
+    flag,
+    mask,
+    block
+  };
+
+  chat_filter()
+  {
+    classes_.fill(0);
+    add_state();
+  }
+
+  // throws if the file can not be read
+  static std::shared_ptr<chat_filter const> load(std::string const& path)
+  {
+    std::ifstream in {path};
+    if (! in)
+    {
+      throw std::runtime_error("could not open filter file '" + path + "'");
+    }
+
+    auto filter = std::make_shared<chat_filter>();
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+      if (! line.empty() && line.back() == '\r')
+      {
+        line.pop_back();
+      }
+
+      if (line.empty() || line[0] == '#')
+      {
+        continue;
+      }
+
+      auto const space = line.find(' ');
+      if (space == std::string::npos)
+      {
+        continue;
+      }
+
+      auto const name = line.substr(0, space);
+      auto const phrase = line.substr(space + 1);
+
+      if (name == "block")
+      {
+        filter->add(phrase, action::block);
+      }
+      else if (name == "mask")
+      {
+        filter->add(phrase, action::mask);
+      }
+      else if (name == "flag")
+      {
+        filter->add(phrase, action::flag);
+      }
+    }
+
+    filter->build();
+
+    return filter;
+  }
+
+  // only valid before build
+  void add(boost::string_view phrase, action act)
+  {
+    if (phrase.empty())
+    {
+      return;
+    }
+
+    std::size_t state {0};
+    for (auto const c : phrase)
+    {
+      auto const byte = lower(c);
+      used_[byte] = true;
+
+      auto& children = trie_[state];
+      auto it = std::find_if(children.begin(), children.end(),
+        [byte](edge const& e) { return e.first == byte; });
+
+      if (it == children.end())
+      {
+        auto const child = static_cast<std::uint32_t>(add_state());
+        trie_[state].emplace_back(byte, child);
+        state = child;
+      }
+      else
+      {
+        state = it->second;
+      }
+    }
+
+    auto& out = outputs_[state];
+    out.act = std::max(out.act, act);
+    if (act >= action::mask)
+    {
+      out.length = std::max(out.length, static_cast<std::uint32_t>(phrase.size()));
+    }
+
+    ++size_;
+  }
+
+  // compile the added phrases
+  void build()
+  {
+    // bytes that appear in no phrase share class 0 and always lead back
+    // to the start
+    std::size_t count {1};
+    for (std::size_t c = 0; c < 256; ++c)
+    {
+      if (used_[c])
+      {
+        classes_[c] = static_cast<std::uint16_t>(count++);
+      }
+    }
+    for (std::size_t c = 0; c < 256; ++c)
+    {
+      classes_[c] = classes_[lower(static_cast<char>(c))];
+    }
+    class_count_ = count;
+
+    auto const states = trie_.size();
+    if (states * class_count_ > row_mask)
+    {
+      throw std::runtime_error("too many filter phrases");
+    }
+
+    next_.assign(states * class_count_, 0);
+    std::vector<std::uint32_t> fail (states, 0);
+
+    // breadth first, so the fail state of a node is always complete
+    std::deque<std::uint32_t> queue;
+    for (auto const& e : trie_[0])
+    {
+      next_[classes_[e.first]] = e.second;
+      queue.emplace_back(e.second);
+    }
+
+    while (! queue.empty())
+    {
+      auto const state = queue.front();
+      queue.pop_front();
+
+      auto const f = fail[state];
+      auto& out = outputs_[state];
+      out.act = std::max(out.act, outputs_[f].act);
+      out.length = std::max(out.length, outputs_[f].length);
+
+      auto const row = state * class_count_;
+      std::copy_n(next_.begin() + static_cast<std::ptrdiff_t>(f * class_count_), class_count_,
+        next_.begin() + static_cast<std::ptrdiff_t>(row));
+
+      for (auto const& e : trie_[state])
+      {
+        fail[e.second] = next_[f * class_count_ + classes_[e.first]];
+        next_[row + classes_[e.first]] = e.second;
+        queue.emplace_back(e.second);
+      }
+    }
+
+    // each entry holds the start of the next state's row, with the action
+    // of that state in the top bits, so a step is a single load
+    for (auto& next : next_)
+    {
+      next = static_cast<std::uint32_t>(next * class_count_) |
+        (static_cast<std::uint32_t>(outputs_[next].act) << action_shift);
+    }
+
+    // only the compiled tables are kept
+    trie_.clear();
+    trie_.shrink_to_fit();
+  }
+
+  // number of phrases
+  std::size_t size() const
+  {
+    return size_;
+  }
+
+  // the most severe action of the phrases found in the text
+  action check(boost::string_view text) const
+  {
+    std::uint32_t row {0};
+    std::uint32_t act {0};
+
+    for (auto const c : text)
+    {
+      auto const next = next_[row + classes_[static_cast<unsigned char>(c)]];
+      row = next & row_mask;
+      act = std::max(act, next >> action_shift);
+    }
+
+    return static_cast<action>(act);
+  }
+
+  // copy of the text with every masked or blocked phrase replaced by '*'
+  std::string mask(boost::string_view text) const
+  {
+    std::string str {text.data(), text.size()};
+
+    std::uint32_t row {0};
+    for (std::size_t i = 0; i < str.size(); ++i)
+    {
+      row = next_[row + classes_[static_cast<unsigned char>(str[i])]] & row_mask;
+
+      auto const length = outputs_[row / class_count_].length;
+      if (length)
+      {
+        std::fill_n(str.begin() + static_cast<std::ptrdiff_t>(i + 1 - length), length, '*');
+      }
+    }
+
+    return str;
+  }
+
+private:
+
+  struct output
+  {
+    action act {action::none};
+
+    // longest masked or blocked phrase ending here
+    std::uint32_t length {0};
+  };
+
+  using edge = std::pair<unsigned char, std::uint32_t>;
+
+  enum : std::uint32_t { action_shift = 30 };
+  enum : std::uint32_t { row_mask = (1u << action_shift) - 1 };
+
+  // ascii only, so bytes of utf-8 sequences are left alone
+  static unsigned char lower(char c)
+  {
+    auto const u = static_cast<unsigned char>(c);
+    return u >= 'A' && u <= 'Z' ? static_cast<unsigned char>(u + ('a' - 'A')) : u;
+  }
+
+  std::size_t add_state()
+  {
+    trie_.emplace_back();
+    outputs_.emplace_back();
+    return trie_.size() - 1;
+  }
+
+  std::size_t size_ {0};
+  std::array<bool, 256> used_ {};
+  std::array<std::uint16_t, 256> classes_;
+  std::size_t class_count_ {1};
+
+  // only used while adding phrases
+  std::vector<std::vector<edge>> trie_;
+
+  std::vector<std::uint32_t> next_;
+  std::vector<output> outputs_;
+};
+
+using chat_filter_ptr = std::shared_ptr<chat_filter const>;
+
+#endif // CHAT_FILTER_HPP
@@ -0,0 +1,173 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CHAT_FLOOD_HPP
+#define CHAT_FLOOD_HPP
+
+#include "chat_metrics.hh"
+#include "chat_sketch.hh"
+
+#include <boost/utility/string_view.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+// token bucket, refills at rate tokens per second up to burst
+class chat_limiter
+{
+public:
+
+  using clock = std::chrono::steady_clock;
+
+  chat_limiter(double rate, double burst) :
+    rate_ {rate},
+    burst_ {burst},
+    tokens_ {burst}
+  {
+  }
+
+  // take a token, false if there is none
+  bool take(clock::time_point now)
+  {
+    if (now < blocked_until_)
+    {
+      return false;
+    }
+
+    auto const elapsed = std::chrono::duration<double>(now - last_).count();
+    last_ = now;
+    tokens_ = std::min(burst_, tokens_ + elapsed * rate_);
+
+    if (tokens_ < 1.0)
+    {
+      return false;
+    }
+
+    tokens_ -= 1.0;
+    return true;
+  }
+
+  // empty the bucket and refuse every token for a while
+  void throttle(clock::time_point now, clock::duration duration)
+  {
+    tokens_ = 0;
+    last_ = now + duration;
+    blocked_until_ = now + duration;
+  }
+
+private:
+
+  double rate_;
+  double burst_;
+  double tokens_;
+  clock::time_point last_ {clock::now()};
+  clock::time_point blocked_until_ {};
+};
+
+// flood detection across every room of the server
+//
+// nothing is kept per message or per user, the sketches below have a fixed
+// size and are cleared at the start of every window:
+//   count-min over sender names finds heavy hitters
+//   count-min over the bands of each message's simhash, keyed by sender,
+//   finds a sender repeating near identical messages, two simhashes a few
+//   bits apart always share one of the four 16 bit bands
+//   hyperloglog over sender names counts the active users
+class chat_flood
+{
+public:
+
+  // length of a window in seconds
+  enum { window = 10 };
+
+  // messages a sender may send per window
+  enum { max_msgs = 300 };
+
+  // near identical messages a sender may send per window
+  enum { max_duplicates = 10 };
+
+  // per session rate limit, messages per second and burst, well above
+  // what a person types
+  enum { rate = 100 };
+  enum { burst = 200 };
+
+  // seconds a flooding sender is refused every message
+  enum { penalty = 10 };
+
+  explicit chat_flood(chat_metrics& metrics) :
+    metrics_ {metrics}
+  {
+  }
+
+  // count a message, true if its sender is flooding
+  bool observe(boost::string_view user, boost::string_view text)
+  {
+    auto const sender = chat_hash(user);
+
+    ++metrics_.msgs;
+    users_.add(sender);
+
+    bool flood {false};
+
+    if (senders_.excess(senders_.add(sender)) > max_msgs)
+    {
+      ++metrics_.heavy_hitters;
+      flood = true;
+    }
+
+    auto const simhash = chat_simhash(text);
+    std::uint32_t repeats {0};
+    for (std::uint64_t band = 0; band < 4; ++band)
+    {
+      auto const key = ((simhash >> (band * 16)) & 0xffff) | (band << 16);
+      repeats = std::max(repeats, bands_.excess(bands_.add(chat_hash({}, sender ^ key))));
+    }
+
+    if (repeats > max_duplicates)
+    {
+      ++metrics_.duplicates;
+      flood = true;
+    }
+
+    return flood;
+  }
+
+  chat_metrics& metrics()
+  {
+    return metrics_;
+  }
+
+  // when disabled nothing is tracked or limited, for load testing
+  bool enabled() const
+  {
+    return enabled_;
+  }
+
+  void enabled(bool value)
+  {
+    enabled_ = value;
+  }
+
+  // start a new window
+  void rotate()
+  {
+    metrics_.active_users = static_cast<std::uint64_t>(users_.estimate() + 0.5);
+
+    senders_.clear();
+    bands_.clear();
+    users_.clear();
+  }
+
+private:
+
+  chat_metrics& metrics_;
+  bool enabled_ {true};
+  chat_count_min senders_;
+  chat_count_min bands_;
+  chat_hyperloglog users_;
+};
+
+#endif // CHAT_FLOOD_HPP
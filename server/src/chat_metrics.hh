@@ -0,0 +1,71 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CHAT_METRICS_HPP
+#define CHAT_METRICS_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// server counters, reported and reset once per window
+struct chat_metrics
+{
+  // room and private messages received
+  std::uint64_t msgs {0};
+
+  // distinct users that sent a message, estimated
+  std::uint64_t active_users {0};
+
+  // messages from a sender over the per window limit
+  std::uint64_t heavy_hitters {0};
+
+  // messages close to one the sender already sent this window
+  std::uint64_t duplicates {0};
+
+  // times a sender was throttled by the flood detector
+  std::uint64_t throttled {0};
+
+  // messages dropped by the rate limiter
+  std::uint64_t rate_limited {0};
+
+  // room messages dropped for lossy observers that fell behind
+  std::uint64_t observer_drops {0};
+
+  // observers disconnected for falling behind
+  std::uint64_t observer_kicks {0};
+
+  // longest a single read or fan-out handler ran, in microseconds
+  std::uint64_t max_handler_us {0};
+
+  void handler_time(std::chrono::steady_clock::duration duration)
+  {
+    max_handler_us = std::max(max_handler_us, static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(duration).count()));
+  }
+
+  void report(std::ostream& out) const
+  {
+    out
+      << "metrics: {\"msgs\":" << msgs
+      << ",\"active_users\":" << active_users
+      << ",\"heavy_hitters\":" << heavy_hitters
+      << ",\"duplicates\":" << duplicates
+      << ",\"throttled\":" << throttled
+      << ",\"rate_limited\":" << rate_limited
+      << ",\"observer_drops\":" << observer_drops
+      << ",\"observer_kicks\":" << observer_kicks
+      << ",\"max_handler_us\":" << max_handler_us
+      << "}\n";
+  }
+
+  void reset()
+  {
+    *this = chat_metrics {};
+  }
+};
+
+#endif // CHAT_METRICS_HPP
@@ -0,0 +1,203 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CHAT_SKETCH_HPP
+#define CHAT_SKETCH_HPP
+
+#include <boost/utility/string_view.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+// streaming sketches with a fixed footprint, whatever the traffic
+
+// fnv-1a with a final mix, so every bit of the result depends on the input
+inline std::uint64_t chat_hash(boost::string_view str, std::uint64_t seed = 0)
+{
+  std::uint64_t h {0xcbf29ce484222325ull ^ seed};
+  for (auto const c : str)
+  {
+    h ^= static_cast<unsigned char>(c);
+    h *= 0x100000001b3ull;
+  }
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+
+  return h;
+}
+
+// simhash of the words of a text, near identical texts differ in few bits
+inline std::uint64_t chat_simhash(boost::string_view text)
+{
+  std::array<std::int32_t, 64> weights {};
+
+  std::size_t pos {0};
+  while (pos < text.size())
+  {
+    while (pos < text.size() && text[pos] == ' ')
+    {
+      ++pos;
+    }
+
+    auto const end = std::min(text.find(' ', pos), text.size());
+    if (end == pos)
+    {
+      break;
+    }
+
+    auto const h = chat_hash(text.substr(pos, end - pos));
+    for (std::size_t i = 0; i < 64; ++i)
+    {
+      weights[i] += (h >> i) & 1 ? 1 : -1;
+    }
+
+    pos = end;
+  }
+
+  std::uint64_t hash {0};
+  for (std::size_t i = 0; i < 64; ++i)
+  {
+    if (weights[i] > 0)
+    {
+      hash |= std::uint64_t {1} << i;
+    }
+  }
+
+  return hash;
+}
+
+// count-min sketch with conservative update, estimates never undercount
+//
+// every counter is shared by about total / width keys, so at volume an
+// estimate carries that much of other keys' counts, compare excess rather
+// than the raw estimate against a threshold
+class chat_count_min
+{
+public:
+
+  // 4 x 16384 counters, 256 KiB, keeps the expected error of a million
+  // adds per window at about 61
+  enum { width = 16384 };
+  enum { depth = 4 };
+
+  // add one to the key's count and return its new estimate
+  std::uint32_t add(std::uint64_t hash)
+  {
+    ++total_;
+    auto const estimate = this->estimate(hash) + 1;
+
+    for (std::size_t i = 0; i < depth; ++i)
+    {
+      auto& counter = counters_[i][index(hash, i)];
+      counter = std::max(counter, estimate);
+    }
+
+    return estimate;
+  }
+
+  std::uint32_t estimate(std::uint64_t hash) const
+  {
+    auto estimate = counters_[0][index(hash, 0)];
+    for (std::size_t i = 1; i < depth; ++i)
+    {
+      estimate = std::min(estimate, counters_[i][index(hash, i)]);
+    }
+
+    return estimate;
+  }
+
+  // an estimate less the expected error, what the key has counted over the
+  // average counter
+  std::uint32_t excess(std::uint32_t estimate) const
+  {
+    auto const noise = static_cast<std::uint32_t>(total_ / width);
+    return estimate > noise ? estimate - noise : 0;
+  }
+
+  void clear()
+  {
+    for (auto& row : counters_)
+    {
+      row.fill(0);
+    }
+
+    total_ = 0;
+  }
+
+private:
+
+  // a row index per row from the two halves of the hash
+  static std::size_t index(std::uint64_t hash, std::size_t row)
+  {
+    auto const h1 = hash & 0xffffffff;
+    auto const h2 = hash >> 32;
+    return static_cast<std::size_t>((h1 + row * h2) % width);
+  }
+
+  std::array<std::array<std::uint32_t, width>, depth> counters_ {};
+  std::uint64_t total_ {0};
+};
+
+// hyperloglog, counts distinct keys within about 3%
+class chat_hyperloglog
+{
+public:
+
+  enum { precision = 10 };
+  enum { registers = 1 << precision };
+
+  void add(std::uint64_t hash)
+  {
+    auto const index = static_cast<std::size_t>(hash >> (64 - precision));
+    auto const rest = hash << precision;
+    auto const rank = static_cast<std::uint8_t>(
+      rest ? __builtin_clzll(rest) + 1 : 64 - precision + 1);
+
+    registers_[index] = std::max(registers_[index], rank);
+  }
+
+  double estimate() const
+  {
+    double sum {0};
+    std::size_t zeros {0};
+    for (auto const r : registers_)
+    {
+      sum += std::ldexp(1.0, -r);
+      if (! r)
+      {
+        ++zeros;
+      }
+    }
+
+    auto const m = static_cast<double>(registers);
+    auto const alpha = 0.7213 / (1.0 + 1.079 / m);
+    auto const estimate = alpha * m * m / sum;
+
+    // small counts are better estimated from the empty registers
+    if (estimate <= 2.5 * m && zeros)
+    {
+      return m * std::log(m / static_cast<double>(zeros));
+    }
+
+    return estimate;
+  }
+
+  void clear()
+  {
+    registers_.fill(0);
+  }
+
+private:
+
+  std::array<std::uint8_t, registers> registers_ {};
+};
+
+#endif // CHAT_SKETCH_HPP
@@ -6,22 +6,41 @@
 // This is a derivative work, original copyright below:
 // Copyright (c) 2003-2018 Christopher M. Kohlhoff (chris at kohlhoff dot com)
 
-#include "chat_message.hh"
+#include "chat_bitmap.hh"
+#include "chat_filter.hh"
+#include "chat_flood.hh"
+#include "chat_metrics.hh"
 
-#include "json.hh"
-using Json = nlohmann::json;
+#include "chat_message.hh"
+#include "chat_proto.hh"
+#include "chat_shm.hh"
+#include "chat_type.hh"
 
 #include <boost/asio.hpp>
 using boost::asio::ip::tcp;
+using local = boost::asio::local::stream_protocol;
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
 #include <cstdlib>
 #include <deque>
 #include <iostream>
 #include <list>
+#include <map>
 #include <memory>
 #include <set>
+#include <string>
+#include <tuple>
 #include <utility>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
 
 // passwords should obviously be hashed and salted for real use
 using Users = std::unordered_map<std::string, std::string>;
@@ -45,13 +64,45 @@ public:
 
 using chat_participant_ptr = std::shared_ptr<chat_participant>;
 
+// a room message encoded once, shared by the history and every observer
+using chat_frame = std::shared_ptr<chat_message const>;
+
+// a read only member of a room, handed the shared frames of room messages
+class chat_observer
+{
+public:
+
+  virtual ~chat_observer() {}
+  virtual void deliver(chat_frame const& frame) = 0;
+
+};
+
+using chat_observer_ptr = std::shared_ptr<chat_observer>;
+
+// what a participant wants to receive, nothing set means everything
+struct chat_subscription
+{
+  bool mentions {false};
+  std::vector<std::string> from;
+  std::vector<std::string> words;
+};
+
 class chat_room
 {
 public:
 
+  // recipients a broadcast is delivered to before yielding to the event loop
+  enum { slice = 4096 };
+
+  chat_room(boost::asio::io_context& io_context, chat_metrics& metrics) :
+    io_context_ {io_context},
+    metrics_ {metrics}
+  {
+  }
+
   bool contains(std::string name)
   {
-    if (participants_.find(name) == participants_.end())
+    if (slots_.find(name) == slots_.end())
     {
       return false;
     }
@@ -59,325 +110,1683 @@ public:
     return true;
   }
 
-  void join(std::string name, chat_participant_ptr participant)
+  // a participant that asked for acks is left out of the fan-out of its
+  // own messages
+  void join(std::string name, chat_participant_ptr participant, std::uint64_t since,
+    bool acks)
   {
-    participants_.emplace(name, participant);
+    auto const slot = take_slot();
+    members_[slot].name = name;
+    members_[slot].participant = participant;
+    slots_.emplace(name, slot);
+    everything_.set(slot);
 
-    for (auto msg: recent_msgs_)
+    if (acks)
     {
-      participant->deliver(msg);
+      acks_.set(slot);
     }
-  }
 
-  void leave(std::string name)
-  {
-    participants_.erase(name);
+    // a client that has seen a later sequence number was talking to a
+    // previous run of the server, send it everything
+    if (since > seq_)
+    {
+      since = 0;
+    }
+
+    for (auto const& msg: recent_msgs_)
+    {
+      if (msg.first > since)
+      {
+        participant->deliver(*msg.second);
+      }
+    }
   }
 
-  void deliver(chat_message const& msg)
+  // observers have no name and no subscription, they get every room
+  // message and nothing else, returns the slot to unwatch with
+  std::size_t watch(chat_observer_ptr observer, std::uint64_t since)
   {
-    recent_msgs_.emplace_back(msg);
+    auto const slot = take_slot();
+    members_[slot].observer = observer;
+    everything_.set(slot);
 
-    while (recent_msgs_.size() > max_recent_msgs)
+    if (since > seq_)
     {
-      recent_msgs_.pop_front();
+      since = 0;
     }
 
-    for (auto participant: participants_)
+    for (auto const& msg: recent_msgs_)
     {
-      participant.second->deliver(msg);
+      if (msg.first > since)
+      {
+        observer->deliver(msg.second);
+      }
     }
+
+    return slot;
   }
 
-  void deliver(std::string const& str)
+  void unwatch(std::size_t slot, chat_observer const* observer)
   {
-    chat_message msg {str};
-
-    recent_msgs_.emplace_back(msg);
-
-    while (recent_msgs_.size() > max_recent_msgs)
+    if (slot >= members_.size() || members_[slot].observer.get() != observer)
     {
-      recent_msgs_.pop_front();
+      return;
     }
 
-    for (auto participant: participants_)
+    everything_.reset(slot);
+    members_[slot] = member {};
+    release(slot);
+  }
+
+  // only the participant that joined under the name leaves
+  void leave(std::string const& name, chat_participant const* participant)
+  {
+    auto const it = slots_.find(name);
+    if (it == slots_.end() || members_[it->second].participant.get() != participant)
     {
-      participant.second->deliver(msg);
+      return;
     }
+
+    auto const slot = it->second;
+    unsubscribe(slot);
+    everything_.reset(slot);
+    acks_.reset(slot);
+    members_[slot] = member {};
+    slots_.erase(it);
+    release(slot);
   }
 
-  void deliver(std::string to, std::string from, std::string const& msg)
+  // replace the subscription of a participant
+  void subscribe(std::string const& name, chat_subscription sub)
   {
-    auto user = participants_.find(to);
-    if (user != participants_.end())
+    auto const it = slots_.find(name);
+    if (it == slots_.end())
     {
-      Json jres;
-      jres["type"] = "prv";
-      jres["from"] = from;
-      jres["msg"] = msg;
+      return;
+    }
+
+    auto const slot = it->second;
+    unsubscribe(slot);
 
-      // send a message to the user
-      user->second->deliver(jres.dump());
+    auto& entry = members_[slot];
+    entry.sub = std::move(sub);
+
+    if (! entry.sub.mentions && entry.sub.from.empty() && entry.sub.words.empty())
+    {
+      everything_.set(slot);
+      return;
     }
-  }
 
-private:
+    if (entry.sub.mentions)
+    {
+      mentions_.set(slot);
+    }
 
-  int const max_recent_msgs {128};
-  chat_message_queue recent_msgs_;
-  std::unordered_map<std::string, chat_participant_ptr> participants_;
-};
+    for (auto const& user : entry.sub.from)
+    {
+      from_[user].set(slot);
+    }
 
-class chat_session :
-  public chat_participant,
-  public std::enable_shared_from_this<chat_session>
-{
-public:
+    for (auto const& word : entry.sub.words)
+    {
+      words_[word].set(slot);
+    }
+  }
 
-  chat_session(tcp::socket socket, chat_room& room) :
-    socket_ {std::move(socket)},
-    room_ {room}
+  // sequence number of the last room message
+  std::uint64_t seq() const
   {
+    return seq_;
   }
 
-  void start()
+  // stamp the next sequence number on a room message and send it to every
+  // participant whose subscription it matches, the sender included unless
+  // it asked for acks, returns false if the stamped message is too long
+  bool deliver(chat_msg& msg_)
   {
-    do_read_header();
+    msg_.seq = seq_ + 1;
+
+    // written straight into the frame that is shared with the history, the
+    // pending broadcasts and the observers
+    auto frame = std::make_shared<chat_message>();
+    if (! chat_encode(msg_, *frame))
+    {
+      return false;
+    }
+
+    chat_frame const msg {std::move(frame)};
+    ++seq_;
+
+    recent_msgs_.emplace_back(seq_, msg);
+
+    while (recent_msgs_.size() > max_recent_msgs)
+    {
+      recent_msgs_.pop_front();
+    }
+
+    auto const& to = recipients(msg_);
+
+    // a broadcast to a huge room goes out a slice at a time, the ones after
+    // it wait their turn so everyone sees the room in order
+    if (pending_.empty())
+    {
+      // an observer may close, and leave its slot, from within the fan-out
+      fanning_out_ = true;
+      std::size_t budget {slice};
+      auto const next = fan_out(msg, to, 0, budget);
+      fanning_out_ = false;
+
+      if (next != chat_bitmap::npos)
+      {
+        pending_.emplace_back(broadcast {msg, to, next});
+        schedule();
+      }
+      else
+      {
+        reclaim();
+      }
+    }
+    else
+    {
+      pending_.emplace_back(broadcast {msg, to, 0});
+    }
+
+    return true;
   }
 
-  void deliver(chat_message const& msg)
+  void deliver(std::string const& to, std::string const& from, boost::string_view msg)
   {
-    bool write_in_progress = !write_msgs_.empty();
-    write_msgs_.emplace_back(msg);
-
-    if (! write_in_progress)
+    auto user = slots_.find(to);
+    if (user != slots_.end())
     {
-      do_write();
+      chat_prv res;
+      res.from = from;
+      res.msg = msg;
+
+      chat_message frame;
+      if (chat_encode(res, frame))
+      {
+        // send a message to the user
+        members_[user->second].participant->deliver(frame);
+      }
     }
   }
 
-  void deliver(std::string const& str)
+private:
+
+  // a slot holds either a participant or an observer
+  struct member
+  {
+    std::string name;
+    chat_participant_ptr participant;
+    chat_observer_ptr observer;
+    chat_subscription sub;
+  };
+
+  // a room message part way through its fan-out
+  struct broadcast
+  {
+    chat_frame msg;
+    chat_bitmap to;
+    std::size_t next;
+  };
+
+  // every member gets a small slot number, the recipients of a broadcast
+  // are a bitmap of slots
+  std::size_t take_slot()
   {
-    chat_message msg {str};
+    std::size_t slot {members_.size()};
+    if (free_.empty())
+    {
+      members_.emplace_back();
+    }
+    else
+    {
+      slot = free_.back();
+      free_.pop_back();
+    }
 
-    bool write_in_progress = !write_msgs_.empty();
-    write_msgs_.emplace_back(msg);
+    return slot;
+  }
 
-    if (! write_in_progress)
+  // a broadcast still going out may hold the slot, it is only reused once
+  // they are all done
+  void release(std::size_t slot)
+  {
+    if (pending_.empty() && ! fanning_out_)
     {
-      do_write();
+      free_.emplace_back(slot);
+    }
+    else
+    {
+      tombstones_.emplace_back(slot);
     }
   }
 
-private:
-  void do_read_header()
+  // the slots left during the broadcasts are free once they are all out
+  void reclaim()
   {
-    auto self {shared_from_this()};
+    free_.insert(free_.end(), tombstones_.begin(), tombstones_.end());
+    tombstones_.clear();
+  }
 
-    boost::asio::async_read(socket_,
-      boost::asio::buffer(read_msg_.data(), chat_message::header_length),
-      [this, self](boost::system::error_code ec, std::size_t /*length*/)
+  // deliver to the recipients from slot from on while the budget lasts,
+  // returns where to carry on from, or npos once done
+  std::size_t fan_out(chat_frame const& msg, chat_bitmap const& to,
+    std::size_t from, std::size_t& budget)
+  {
+    return to.for_each(from, budget, [&](std::size_t slot)
       {
-        if (! ec && read_msg_.decode_header())
+        --budget;
+
+        // left since the broadcast started, participants copy the frame
+        // into their queue, observers share it
+        auto const& entry = members_[slot];
+        if (entry.participant)
         {
-          do_read_body();
+          entry.participant->deliver(*msg);
         }
-        else
+        else if (entry.observer)
         {
-          room_.leave(user_);
+          entry.observer->deliver(msg);
         }
       }
     );
   }
 
-  void do_read_body()
+  // carry on with the pending broadcasts for one slice
+  void resume()
   {
-    auto self(shared_from_this());
+    auto const start = std::chrono::steady_clock::now();
 
-    boost::asio::async_read(socket_,
-      boost::asio::buffer(read_msg_.body(), read_msg_.body_length()),
-      [this, self](boost::system::error_code ec, std::size_t /*length*/)
+    std::size_t budget {slice};
+    while (! pending_.empty() && budget)
+    {
+      auto& front = pending_.front();
+      front.next = fan_out(front.msg, front.to, front.next, budget);
+      if (front.next != chat_bitmap::npos)
       {
-        if (! ec)
-        {
-          // parse json from body
-          std::string req {read_msg_.body(), read_msg_.body_length()};
-          Json jreq = Json::parse(req);
-          std::cerr << "request: " << jreq.dump() << "\n";
-          std::string type {jreq["type"].get<std::string>()};
-          std::cerr << "type: " << type << "\n\n";
+        break;
+      }
 
-          if (auth_)
-          {
-            // switch on type and perform action
-            if (type == "msg")
-            {
-              room_.deliver(read_msg_);
-            }
-            else if (type == "prv")
-            {
-              std::string to {jreq["to"].get<std::string>()};
-              std::string msg {jreq["msg"].get<std::string>()};
+      pending_.pop_front();
+    }
 
-              // send private message to user
-              room_.deliver(to, user_, msg);
-            }
-            // else if (type == "")
-            // {
-            //   // do something else
-            // }
-          }
-          else
-          {
-            if (type == "auth")
-            {
-              std::string user {jreq["user"].get<std::string>()};
-              std::string pass {jreq["pass"].get<std::string>()};
-
-              auto check_user = user_db.find(user);
-              if (check_user != user_db.end() && check_user->first == user && check_user->second == pass && ! room_.contains(user))
-              {
-                auth_ = true;
-                user_ = user;
-
-                Json jres;
-                jres["type"] = "srv";
-                jres["str"] = "Success: logged in";
-
-                // send a message to user
-                deliver(jres.dump());
-
-                // add user to chat room
-                room_.join(user_, shared_from_this());
-              }
-              else
-              {
-                Json jres;
-                jres["type"] = "srv";
-                jres["str"] = "Error: incorrect user or pass, disconnecting...";
-
-                // send just to user
-                deliver(jres.dump());
-
-                // close connection
-                do_close();
-              }
-            }
-            else
-            {
-              Json jres;
-              jres["type"] = "srv";
-              jres["str"] = "Error: please authenticate with '/auth <user> <pass>'";
+    if (pending_.empty())
+    {
+      reclaim();
+    }
+    else
+    {
+      schedule();
+    }
 
-              deliver(jres.dump());
-            }
-          }
+    metrics_.handler_time(std::chrono::steady_clock::now() - start);
+  }
 
-          do_read_header();
-        }
-        else
-        {
-          room_.leave(user_);
-        }
+  void schedule()
+  {
+    boost::asio::post(io_context_, [this]() { resume(); });
+  }
+
+  // the subscriptions are evaluated once per message, each adds the slots
+  // it matches to the recipients
+  chat_bitmap const& recipients(chat_msg const& msg)
+  {
+    recipients_.assign(everything_);
+
+    word_.assign(msg.user.data(), msg.user.size());
+    auto const sender = slots_.find(word_);
+
+    if (! from_.empty())
+    {
+      auto const it = from_.find(word_);
+      if (it != from_.end())
+      {
+        recipients_.merge(it->second);
       }
-    );
+    }
+
+    if (! mentions_.none() || ! words_.empty())
+    {
+      match(msg.msg);
+    }
+
+    // the sender gets its echo back unless it asked for an ack, settled
+    // once here so the fan-out has no per recipient case for it
+    if (sender != slots_.end())
+    {
+      if (acks_.test(sender->second))
+      {
+        recipients_.reset(sender->second);
+      }
+      else
+      {
+        recipients_.set(sender->second);
+      }
+    }
+
+    return recipients_;
   }
 
-  void do_write()
+  // add the slots subscribed to the words and @mentions of the text
+  void match(boost::string_view text)
   {
-    auto self(shared_from_this());
+    // split the text into words and @mentions once
+    std::size_t pos {0};
+    while (pos < text.size())
+    {
+      while (pos < text.size() && ! word_char(text[pos]) && text[pos] != '@')
+      {
+        ++pos;
+      }
 
-    boost::asio::async_write(socket_,
-      boost::asio::buffer(write_msgs_.front().data(),
-      write_msgs_.front().length()),
-      [this, self](boost::system::error_code ec, std::size_t /*length*/)
+      bool const mention {pos < text.size() && text[pos] == '@'};
+      if (mention)
       {
-        if (! ec)
-        {
-          write_msgs_.pop_front();
+        ++pos;
+      }
 
-          if (! write_msgs_.empty())
-          {
-            do_write();
-          }
+      auto const begin = pos;
+      while (pos < text.size() && word_char(text[pos]))
+      {
+        ++pos;
+      }
+
+      if (pos == begin)
+      {
+        continue;
+      }
+
+      word_.assign(text.data() + begin, pos - begin);
+
+      if (mention)
+      {
+        auto const it = slots_.find(word_);
+        if (it != slots_.end() && mentions_.test(it->second))
+        {
+          recipients_.set(it->second);
         }
-        else
+      }
+
+      if (! words_.empty())
+      {
+        std::transform(word_.begin(), word_.end(), word_.begin(),
+          [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+
+        auto const it = words_.find(word_);
+        if (it != words_.end())
         {
-          room_.leave(user_);
+          recipients_.merge(it->second);
         }
       }
-    );
+    }
   }
 
-  void do_close()
+  static bool word_char(char c)
   {
-    // send a tcp shutdown
-    boost::system::error_code ec;
-    socket_.shutdown(tcp::socket::shutdown_send, ec);
+    auto const u = static_cast<unsigned char>(c);
+    return std::isalnum(u) || c == '_' || c == '-' || u >= 0x80;
+  }
 
-    if (ec)
+  void unsubscribe(std::size_t slot)
+  {
+    auto& entry = members_[slot];
+
+    everything_.reset(slot);
+    mentions_.reset(slot);
+
+    for (auto const& user : entry.sub.from)
     {
-      return;
+      auto const it = from_.find(user);
+      if (it != from_.end())
+      {
+        it->second.reset(slot);
+        if (it->second.none())
+        {
+          from_.erase(it);
+        }
+      }
+    }
+
+    for (auto const& word : entry.sub.words)
+    {
+      auto const it = words_.find(word);
+      if (it != words_.end())
+      {
+        it->second.reset(slot);
+        if (it->second.none())
+        {
+          words_.erase(it);
+        }
+      }
     }
+
+    entry.sub = chat_subscription {};
   }
 
-  tcp::socket socket_;
-  chat_room& room_;
-  chat_message read_msg_;
-  chat_message_queue write_msgs_;
-  bool auth_ {false};
-  std::string user_ {};
+  boost::asio::io_context& io_context_;
+  chat_metrics& metrics_;
+
+  std::size_t const max_recent_msgs {128};
+  std::uint64_t seq_ {0};
+  std::deque<std::pair<std::uint64_t, chat_frame>> recent_msgs_;
+
+  // participants and observers by slot, free slots are reused
+  std::vector<member> members_;
+  std::vector<std::size_t> free_;
+  std::unordered_map<std::string, std::size_t> slots_;
+
+  // broadcasts still going out, the first one while it is being fanned out
+  // inline, and the slots left during them
+  std::deque<broadcast> pending_;
+  bool fanning_out_ {false};
+  std::vector<std::size_t> tombstones_;
+
+  // slots without a subscription, with a mention subscription, and by the
+  // sender or word they subscribed to
+  chat_bitmap everything_;
+  chat_bitmap mentions_;
+
+  // slots that get an ack from their session instead of their own echo
+  chat_bitmap acks_;
+  std::unordered_map<std::string, chat_bitmap> from_;
+  std::unordered_map<std::string, chat_bitmap> words_;
+
+  // scratch space reused for every message
+  chat_bitmap recipients_;
+  std::string word_;
 };
 
-class chat_server
+// rooms by name, created on first use, every listener given the same name
+// accepts into the same room, so a message is fanned out and kept in
+// history once whichever listener its sender and recipients came in on
+class chat_rooms
 {
 public:
-  chat_server(boost::asio::io_context& io_context,
-    const tcp::endpoint& endpoint) :
-    acceptor_ {io_context, endpoint}
+
+  chat_rooms(boost::asio::io_context& io_context, chat_metrics& metrics) :
+    io_context_ {io_context},
+    metrics_ {metrics}
   {
-    do_accept();
   }
 
-private:
-  void do_accept()
+  chat_room& get(std::string const& name)
   {
-    acceptor_.async_accept(
-      [this](boost::system::error_code ec, tcp::socket socket)
-      {
-        if (! ec)
-        {
-          std::make_shared<chat_session>(std::move(socket), room_)->start();
-        }
+    auto it = rooms_.find(name);
+    if (it == rooms_.end())
+    {
+      it = rooms_.emplace(std::piecewise_construct, std::forward_as_tuple(name),
+        std::forward_as_tuple(io_context_, metrics_)).first;
+    }
 
-        do_accept();
-      }
-    );
+    return it->second;
   }
 
-  tcp::acceptor acceptor_;
-  chat_room room_;
+  std::size_t size() const
+  {
+    return rooms_.size();
+  }
+
+private:
+
+  boost::asio::io_context& io_context_;
+  chat_metrics& metrics_;
+
+  // node based, so rooms never move once handed out
+  std::map<std::string, chat_room> rooms_;
 };
 
-int main(int argc, char *argv[])
+// outbound micro-batching, a busy session holds room messages for up to
+// max_window, or until max_bytes are queued, to send them in one write
+struct chat_batching
 {
-  try
-  {
-    if (argc < 2)
-    {
-      std::cerr << "Usage: chat_server <port> [<port> ...]\n";
-      return 1;
-    }
+  std::chrono::microseconds max_window {1000};
+  std::size_t max_bytes {16384};
+};
 
-    boost::asio::io_context io_context;
+// tokens that let a connection join as an observer
+using chat_tokens = std::unordered_set<std::string>;
 
-    std::list<chat_server> servers;
-    for (int i = 1; i < argc; ++i)
-    {
-      tcp::endpoint endpoint(tcp::v4(), std::atoi(argv[i]));
-      servers.emplace_back(io_context, endpoint);
+// a read only observer, taken over from a session once it has sent a watch
+// request with a valid token
+//
+// it keeps no frame of its own, room messages are queued as the frames the
+// room shares, only control frames up to max_control long are read, and
+// writes are posted behind those of the participants. an observer that
+// falls max_queued frames behind is disconnected, or when lossy has its
+// oldest unsent frames dropped, the gap shows in the sequence numbers
+template<typename Stream>
+class chat_watch_session :
+  public chat_observer,
+  public std::enable_shared_from_this<chat_watch_session<Stream>>
+{
+public:
+
+  // longest control frame body read from an observer
+  enum { max_control = 128 };
+
+  // unsent frames kept for a slow observer
+  enum { max_queued = 256 };
+
+  // max number of queued frames handed to a single gather write
+  enum { max_gather = 16 };
+
+  chat_watch_session(Stream socket, chat_room& room, chat_metrics& metrics, bool lossy) :
+    socket_ {std::move(socket)},
+    room_ {room},
+    metrics_ {metrics},
+    lossy_ {lossy}
+  {
+  }
+
+  void start(std::uint64_t since)
+  {
+    slot_ = room_.watch(this->shared_from_this(), since);
+
+    // after the replay, the sequence number tells the client where the
+    // room is at
+    chat_srv res;
+    res.str = "Success: watching";
+    res.seq = room_.seq();
+
+    deliver(res);
+
+    do_read_header();
+  }
+
+  void deliver(chat_frame const& frame)
+  {
+    if (closed_)
+    {
+      return;
+    }
+
+    if (queue_.size() - writing_ >= max_queued)
+    {
+      if (! lossy_)
+      {
+        ++metrics_.observer_kicks;
+        std::cerr << "observer: disconnected, fell behind\n";
+
+        close();
+        return;
+      }
+
+      ++metrics_.observer_drops;
+      queue_.erase(queue_.begin() + static_cast<std::ptrdiff_t>(writing_));
+    }
+
+    queue_.emplace_back(frame);
+
+    // written once the handler that delivered it is done, so the
+    // participants' writes go first and a whole fan-out slice is gathered
+    if (! writing_ && ! write_posted_)
+    {
+      write_posted_ = true;
+
+      auto self(this->shared_from_this());
+      boost::asio::post(socket_.get_executor(), [this, self]()
+        {
+          write_posted_ = false;
+          if (! writing_ && ! closed_)
+          {
+            do_write();
+          }
+        }
+      );
+    }
+  }
+
+private:
+
+  // replies are rare, they get a frame of their own
+  template<typename T>
+  void deliver(T const& res)
+  {
+    auto frame = std::make_shared<chat_message>();
+    if (chat_encode(res, *frame))
+    {
+      deliver(chat_frame {std::move(frame)});
+    }
+  }
+
+  void do_read_header()
+  {
+    auto self(this->shared_from_this());
+
+    boost::asio::async_read(socket_,
+      boost::asio::buffer(read_, chat_message::header_length),
+      [this, self](boost::system::error_code ec, std::size_t /*length*/)
+      {
+        std::size_t length {0};
+        if (! ec && chat_message::decode_header(read_, length) && length <= max_control)
+        {
+          do_read_body(length);
+        }
+        else
+        {
+          close();
+        }
+      }
+    );
+  }
+
+  void do_read_body(std::size_t body_length)
+  {
+    auto self(this->shared_from_this());
+
+    boost::asio::async_read(socket_,
+      boost::asio::buffer(read_ + chat_message::header_length, body_length),
+      [this, self](boost::system::error_code ec, std::size_t length)
+      {
+        if (ec)
+        {
+          close();
+          return;
+        }
+
+        auto& reader = shared_reader();
+        if (reader.parse(read_ + chat_message::header_length, length))
+        {
+          // everything else is ignored, an observer can't send to the room
+          auto const handler = handlers()[reader.type()];
+          if (handler)
+          {
+            (this->*handler)(reader);
+          }
+        }
+
+        do_read_header();
+      }
+    );
+  }
+
+  // one parser for every observer, the server runs on a single thread and a
+  // frame is parsed and handled in one go
+  static chat_reader& shared_reader()
+  {
+    static chat_reader reader;
+    return reader;
+  }
+
+  using frame_handler = void (chat_watch_session::*)(chat_reader const&);
+
+  static chat_dispatch<frame_handler> const& handlers()
+  {
+    static chat_dispatch<frame_handler> const handlers {chat_dispatch<frame_handler> {}
+      .on(chat_type::ping, &chat_watch_session::handle_ping)
+    };
+
+    return handlers;
+  }
+
+  void handle_ping(chat_reader const& reader)
+  {
+    chat_pong res;
+    res.t = reader.get<chat_ping>().t;
+
+    deliver(res);
+  }
+
+  void do_write()
+  {
+    auto self(this->shared_from_this());
+
+    writing_ = std::min<std::size_t>(queue_.size(), max_gather);
+
+    write_bufs_.clear();
+    for (std::size_t i = 0; i < writing_; ++i)
+    {
+      write_bufs_.emplace_back(boost::asio::buffer(queue_[i]->data(), queue_[i]->length()));
+    }
+
+    boost::asio::async_write(socket_, write_bufs_,
+      [this, self](boost::system::error_code ec, std::size_t /*length*/)
+      {
+        if (ec || closed_)
+        {
+          close();
+          return;
+        }
+
+        queue_.erase(queue_.begin(), queue_.begin() + static_cast<std::ptrdiff_t>(writing_));
+        writing_ = 0;
+
+        if (! queue_.empty())
+        {
+          do_write();
+        }
+        else if (queue_.capacity() > max_gather)
+        {
+          // a burst is over, give back what it took
+          queue_.shrink_to_fit();
+        }
+      }
+    );
+  }
+
+  void close()
+  {
+    if (closed_)
+    {
+      return;
+    }
+
+    closed_ = true;
+    room_.unwatch(slot_, this);
+
+    // the frames go with the observer, not whenever the socket lets go
+    queue_.clear();
+    queue_.shrink_to_fit();
+
+    boost::system::error_code ec;
+    socket_.close(ec);
+  }
+
+  Stream socket_;
+  chat_room& room_;
+  chat_metrics& metrics_;
+  bool lossy_;
+  bool closed_ {false};
+  bool write_posted_ {false};
+  std::size_t slot_ {0};
+  char read_[chat_message::header_length + max_control];
+
+  // a vector costs nothing while empty, a deque allocates up front
+  std::vector<chat_frame> queue_;
+  std::size_t writing_ {0};
+  std::vector<boost::asio::const_buffer> write_bufs_;
+};
+
+// a participant connected over a stream, a tcp or unix domain socket, or
+// one end of a socket pair for running the server in process
+template<typename Stream>
+class chat_session :
+  public chat_participant,
+  public std::enable_shared_from_this<chat_session<Stream>>
+{
+public:
+
+  chat_session(Stream socket, chat_room& room, chat_filter_ptr const& filter,
+    chat_flood& flood, chat_batching const& batching, chat_tokens const& tokens) :
+    socket_ {std::move(socket)},
+    room_ {room},
+    filter_ {filter},
+    flood_ {flood},
+    batching_ {batching},
+    tokens_ {tokens},
+    batch_timer_ {socket_.get_executor()}
+  {
+  }
+
+  // replies and errors go out on the control lane, ahead of the room
+  // traffic queued on the data lane
+  enum class lane
+  {
+    control,
+    data
+  };
+
+  // max number of queued frames handed to a single gather write
+  enum { max_gather = 64 };
+
+  // share of a gather write kept for the data lane while the control lane
+  // is backed up, so a stream of replies can't starve the room
+  enum { data_share = max_gather / 4 };
+
+  // room messages a batching window is sized to gather
+  enum { batch_frames = 8 };
+
+  void start()
+  {
+    do_read_header();
+  }
+
+  // room messages, kept in order on the data lane
+  void deliver(chat_message const& msg)
+  {
+    queue(lane::data).emplace_back(msg);
+    queued(lane::data);
+  }
+
+  // written straight into the queued frame
+  template<typename T>
+  void deliver(T const& res, lane to = lane::control)
+  {
+    auto& msgs = queue(to);
+    msgs.emplace_back();
+
+    if (! chat_encode(res, msgs.back()))
+    {
+      msgs.pop_back();
+      return;
+    }
+
+    queued(to);
+  }
+
+private:
+  void do_read_header()
+  {
+    auto self {this->shared_from_this()};
+
+    boost::asio::async_read(socket_,
+      boost::asio::buffer(read_msg_.data(), chat_message::header_length),
+      [this, self](boost::system::error_code ec, std::size_t /*length*/)
+      {
+        if (! ec && read_msg_.decode_header())
+        {
+          do_read_body();
+        }
+        else
+        {
+          room_.leave(user_, this);
+        }
+      }
+    );
+  }
+
+  void do_read_body()
+  {
+    auto self(this->shared_from_this());
+
+    boost::asio::async_read(socket_,
+      boost::asio::buffer(read_msg_.body(), read_msg_.body_length()),
+      [this, self](boost::system::error_code ec, std::size_t /*length*/)
+      {
+        if (! ec)
+        {
+          auto const start = std::chrono::steady_clock::now();
+
+          boost::string_view const req {read_msg_.body(), read_msg_.body_length()};
+          std::cerr << "request: " << req << "\n";
+
+          // parse json from body
+          if (reader_.parse(req.data(), req.size()))
+          {
+            std::cerr << "type: " << chat_type_name(reader_.type()) << "\n\n";
+
+            // look up the handler for the type, logged in users get the full
+            // table, everyone else only what is needed to log in
+            auto const handler = (auth_ ? user_handlers() : guest_handlers())[reader_.type()];
+            if (handler)
+            {
+              (this->*handler)(reader_);
+            }
+            else if (! auth_)
+            {
+              chat_srv res;
+              res.str = "Error: please authenticate with '/auth <user> <pass>'";
+
+              deliver(res);
+            }
+          }
+          else if (auto const id = chat_salvage_id(req))
+          {
+            // the sender can still retire the room message it waits on
+            reject("Error: malformed request", id);
+          }
+          else
+          {
+            // nothing the sender could match the error to, and nothing more
+            // from it can be trusted
+            reject("Error: malformed request, disconnecting...", 0);
+            do_close();
+          }
+
+          flood_.metrics().handler_time(std::chrono::steady_clock::now() - start);
+
+          // the socket went to an observer
+          if (! watching_)
+          {
+            do_read_header();
+          }
+        }
+        else
+        {
+          room_.leave(user_, this);
+        }
+      }
+    );
+  }
+
+  using frame_handler = void (chat_session::*)(chat_reader const&);
+
+  static chat_dispatch<frame_handler> const& guest_handlers()
+  {
+    static chat_dispatch<frame_handler> const handlers {chat_dispatch<frame_handler> {}
+      .on(chat_type::ping, &chat_session::handle_ping)
+      .on(chat_type::auth, &chat_session::handle_auth)
+      .on(chat_type::watch, &chat_session::handle_watch)
+    };
+
+    return handlers;
+  }
+
+  static chat_dispatch<frame_handler> const& user_handlers()
+  {
+    static chat_dispatch<frame_handler> const handlers {chat_dispatch<frame_handler> {}
+      .on(chat_type::ping, &chat_session::handle_ping)
+      .on(chat_type::msg, &chat_session::handle_msg)
+      .on(chat_type::prv, &chat_session::handle_prv)
+      .on(chat_type::sub, &chat_session::handle_sub)
+    };
+
+    return handlers;
+  }
+
+  void handle_ping(chat_reader const& reader)
+  {
+    // latency probe, answered right away whether logged in or not
+    chat_pong res;
+    res.t = reader.get<chat_ping>().t;
+
+    deliver(res);
+  }
+
+  // refuse a request, the client id of a room message lets the client
+  // retire it as it would on the echo
+  void reject(char const* str, std::uint64_t id)
+  {
+    chat_srv res;
+    res.str = str;
+    if (id)
+    {
+      res.id = id;
+    }
+
+    deliver(res);
+  }
+
+  // flood detection and rate limiting, false if the message is dropped
+  bool admit(boost::string_view text, std::uint64_t id)
+  {
+    if (! flood_.enabled())
+    {
+      return true;
+    }
+
+    auto const now = chat_limiter::clock::now();
+
+    if (flood_.observe(user_, text))
+    {
+      // refuse everything from the sender for a while
+      limiter_.throttle(now, std::chrono::seconds(chat_flood::penalty));
+      ++flood_.metrics().throttled;
+      std::cerr << "throttled: " << user_ << "\n";
+    }
+
+    if (! limiter_.take(now))
+    {
+      ++flood_.metrics().rate_limited;
+
+      reject("Error: sending too fast, message dropped", id);
+      return false;
+    }
+
+    return true;
+  }
+
+  // run the content filter over the text of a message, false if it is
+  // blocked, a masked copy is kept in masked and replaces the text
+  bool moderate(boost::string_view& text, std::string& masked, std::uint64_t id)
+  {
+    if (! filter_)
+    {
+      return true;
+    }
+
+    switch (filter_->check(text))
+    {
+      case chat_filter::action::block:
+      {
+        std::cerr << "blocked: " << user_ << ": " << text << "\n";
+
+        reject("Error: message blocked by the content filter", id);
+        return false;
+      }
+
+      case chat_filter::action::mask:
+        masked = filter_->mask(text);
+        text = masked;
+        break;
+
+      case chat_filter::action::flag:
+        std::cerr << "flagged: " << user_ << ": " << text << "\n";
+        break;
+
+      default:
+        break;
+    }
+
+    return true;
+  }
+
+  void handle_msg(chat_reader const& reader)
+  {
+    auto req = reader.get<chat_msg>();
+
+    std::string masked;
+    if (! admit(req.msg, req.id) || ! moderate(req.msg, masked, req.id))
+    {
+      return;
+    }
+
+    // messages go out under the name the user logged in with
+    req.user = user_;
+
+    // the room stamps its sequence number on the broadcast
+    if (! room_.deliver(req))
+    {
+      reject("Error: message length too long", req.id);
+      return;
+    }
+
+    if (acks_)
+    {
+      // the room left us out of the fan-out
+      chat_ack res;
+      res.id = req.id;
+      res.seq = req.seq;
+      res.ts = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+
+      deliver(res);
+    }
+  }
+
+  void handle_prv(chat_reader const& reader)
+  {
+    auto req = reader.get<chat_prv>();
+
+    std::string masked;
+    if (! admit(req.msg, 0) || ! moderate(req.msg, masked, 0))
+    {
+      return;
+    }
+
+    // send private message to user
+    room_.deliver(req.to.to_string(), user_, req.msg);
+  }
+
+  void handle_sub(chat_reader const& reader)
+  {
+    auto const req = reader.get<chat_sub>();
+
+    chat_subscription sub;
+    sub.mentions = req.mentions != 0;
+    sub.from = split(req.from, false);
+    sub.words = split(req.words, true);
+
+    room_.subscribe(user_, std::move(sub));
+
+    chat_srv res;
+    res.str = "Success: subscription updated";
+
+    deliver(res);
+  }
+
+  // split a comma separated list, without blanks or duplicates
+  static std::vector<std::string> split(boost::string_view list, bool lower)
+  {
+    std::vector<std::string> items;
+
+    std::size_t pos {0};
+    while (pos <= list.size())
+    {
+      auto const end = std::min(list.find(',', pos), list.size());
+      auto item = list.substr(pos, end - pos);
+
+      while (! item.empty() && item.front() == ' ')
+      {
+        item.remove_prefix(1);
+      }
+      while (! item.empty() && item.back() == ' ')
+      {
+        item.remove_suffix(1);
+      }
+
+      if (! item.empty())
+      {
+        items.emplace_back(item.data(), item.size());
+        if (lower)
+        {
+          auto& str = items.back();
+          std::transform(str.begin(), str.end(), str.begin(),
+            [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+        }
+      }
+
+      pos = end + 1;
+    }
+
+    std::sort(items.begin(), items.end());
+    items.erase(std::unique(items.begin(), items.end()), items.end());
+
+    return items;
+  }
+
+  void handle_auth(chat_reader const& reader)
+  {
+    auto const req = reader.get<chat_auth>();
+    std::string user {req.user.to_string()};
+
+    auto check_user = user_db.find(user);
+    if (check_user != user_db.end() && check_user->first == user && check_user->second == req.pass && ! room_.contains(user))
+    {
+      auth_ = true;
+      acks_ = req.acks != 0;
+      user_ = user;
+
+      // add user to chat room, a reconnecting client only needs what it
+      // missed
+      room_.join(user_, this->shared_from_this(), req.since, acks_);
+
+      // sent after the replay, the sequence number tells the
+      // client where the room is at
+      chat_srv res;
+      res.str = "Success: logged in";
+      res.seq = room_.seq();
+
+      // send a message to user, on the data lane to stay behind the replay
+      deliver(res, lane::data);
+    }
+    else
+    {
+      chat_srv res;
+      res.str = "Error: incorrect user or pass, disconnecting...";
+
+      // send just to user
+      deliver(res);
+
+      // close connection
+      do_close();
+    }
+  }
+
+  // hand the socket over to an observer, which needs a fraction of the
+  // memory of a session, the session goes once its handlers are done
+  void handle_watch(chat_reader const& reader)
+  {
+    auto const req = reader.get<chat_watch>();
+
+    // a reply still going out would be interleaved with the observer's
+    bool const idle {! writing() && control_msgs_.empty() && data_msgs_.empty()};
+
+    if (idle && tokens_.count(req.token.to_string()))
+    {
+      watching_ = true;
+
+      std::make_shared<chat_watch_session<Stream>>(std::move(socket_), room_,
+        flood_.metrics(), req.lossy != 0)->start(req.since);
+    }
+    else
+    {
+      chat_srv res;
+      res.str = idle ? "Error: incorrect token, disconnecting..." :
+        "Error: watch must be the first request, disconnecting...";
+
+      deliver(res);
+      do_close();
+    }
+  }
+
+  chat_message_queue& queue(lane from)
+  {
+    return from == lane::control ? control_msgs_ : data_msgs_;
+  }
+
+  bool writing() const
+  {
+    return writing_control_ || writing_data_;
+  }
+
+  // a frame was queued on a lane, write it now or let room messages wait
+  // for more to join them while the session is busy
+  void queued(lane to)
+  {
+    queued_bytes_ += queue(to).back().length();
+
+    if (to == lane::data)
+    {
+      adapt();
+    }
+
+    if (writing())
+    {
+      return;
+    }
+
+    if (to == lane::control || batch_window_.count() == 0 ||
+      queued_bytes_ >= batching_.max_bytes)
+    {
+      if (batch_armed_)
+      {
+        batch_armed_ = false;
+        batch_timer_.cancel();
+      }
+
+      do_write();
+      return;
+    }
+
+    if (batch_armed_)
+    {
+      return;
+    }
+
+    batch_armed_ = true;
+    batch_timer_.expires_after(batch_window_);
+
+    auto self(this->shared_from_this());
+    batch_timer_.async_wait(
+      [this, self](boost::system::error_code ec)
+      {
+        if (ec || ! batch_armed_)
+        {
+          return;
+        }
+
+        batch_armed_ = false;
+        if (! writing())
+        {
+          do_write();
+        }
+      }
+    );
+  }
+
+  // size the window from the smoothed gap between room messages, long
+  // enough to gather batch_frames of them, closed whenever the gap is wider
+  // than the max window so an idle session writes right away
+  void adapt()
+  {
+    auto const now = std::chrono::steady_clock::now();
+    auto const gap = std::chrono::duration_cast<std::chrono::microseconds>(now - last_queued_);
+    last_queued_ = now;
+
+    if (gap >= batching_.max_window)
+    {
+      gap_ = gap;
+    }
+    else
+    {
+      gap_ += (gap - gap_) / 8;
+    }
+
+    if (gap_ >= batching_.max_window)
+    {
+      batch_window_ = std::chrono::microseconds::zero();
+    }
+    else
+    {
+      batch_window_ = std::min(batching_.max_window, gap_ * batch_frames);
+    }
+  }
+
+  void do_write()
+  {
+    auto self(this->shared_from_this());
+
+    // gather both lanes into a single write, control frames first
+    auto const share = std::min<std::size_t>(data_msgs_.size(), data_share);
+    writing_control_ = std::min<std::size_t>(control_msgs_.size(), max_gather - share);
+    writing_data_ = std::min<std::size_t>(data_msgs_.size(), max_gather - writing_control_);
+
+    write_bufs_.clear();
+    for (std::size_t i = 0; i < writing_control_; ++i)
+    {
+      write_bufs_.emplace_back(boost::asio::buffer(control_msgs_[i].data(),
+        control_msgs_[i].length()));
+    }
+    for (std::size_t i = 0; i < writing_data_; ++i)
+    {
+      write_bufs_.emplace_back(boost::asio::buffer(data_msgs_[i].data(),
+        data_msgs_[i].length()));
+    }
+
+    queued_bytes_ -= std::min(queued_bytes_, boost::asio::buffer_size(write_bufs_));
+
+    boost::asio::async_write(socket_, write_bufs_,
+      [this, self](boost::system::error_code ec, std::size_t /*length*/)
+      {
+        if (! ec)
+        {
+          control_msgs_.erase(control_msgs_.begin(),
+            control_msgs_.begin() + static_cast<std::ptrdiff_t>(writing_control_));
+          data_msgs_.erase(data_msgs_.begin(),
+            data_msgs_.begin() + static_cast<std::ptrdiff_t>(writing_data_));
+          writing_control_ = 0;
+          writing_data_ = 0;
+
+          if (! control_msgs_.empty() || ! data_msgs_.empty())
+          {
+            do_write();
+          }
+        }
+        else
+        {
+          room_.leave(user_, this);
+        }
+      }
+    );
+  }
+
+  void do_close()
+  {
+    // shut down the sending side
+    boost::system::error_code ec;
+    socket_.shutdown(Stream::shutdown_send, ec);
+
+    if (ec)
+    {
+      return;
+    }
+  }
+
+  Stream socket_;
+  chat_room& room_;
+  chat_filter_ptr const& filter_;
+  chat_flood& flood_;
+  chat_batching const& batching_;
+  chat_tokens const& tokens_;
+  chat_limiter limiter_ {chat_flood::rate, chat_flood::burst};
+  chat_message read_msg_;
+  chat_reader reader_;
+  chat_message_queue control_msgs_;
+  chat_message_queue data_msgs_;
+  std::vector<boost::asio::const_buffer> write_bufs_;
+  std::size_t writing_control_ {0};
+  std::size_t writing_data_ {0};
+  std::size_t queued_bytes_ {0};
+  std::chrono::microseconds batch_window_ {0};
+  std::chrono::microseconds gap_ {0};
+  std::chrono::steady_clock::time_point last_queued_ {};
+  boost::asio::steady_timer batch_timer_;
+  bool batch_armed_ {false};
+  bool auth_ {false};
+  bool acks_ {false};
+  bool watching_ {false};
+  std::string user_ {};
+};
+
+// sessions batch their own writes, nagle would only hold the tail of a
+// batch back until the client's delayed ack, which stalls long pastes
+static void no_delay(tcp::socket& socket)
+{
+  boost::system::error_code ignored;
+  socket.set_option(tcp::no_delay(true), ignored);
+}
+
+// unix domain sockets and shared memory have no nagle to turn off
+template<typename Socket>
+static void no_delay(Socket&)
+{
+}
+
+// accepts sessions over a protocol, tcp, a unix domain socket or shared
+// memory, into a room that listeners may share
+template<typename Protocol>
+class chat_server
+{
+public:
+  chat_server(boost::asio::io_context& io_context,
+    typename Protocol::endpoint const& endpoint, chat_room& room,
+    chat_filter_ptr const& filter, chat_flood& flood, chat_batching const& batching,
+    chat_tokens const& tokens) :
+    acceptor_ {io_context, endpoint},
+    room_ {room},
+    filter_ {filter},
+    flood_ {flood},
+    batching_ {batching},
+    tokens_ {tokens}
+  {
+    do_accept();
+  }
+
+private:
+  using socket_type = typename Protocol::socket;
+
+  void do_accept()
+  {
+    acceptor_.async_accept(
+      [this](boost::system::error_code ec, socket_type socket)
+      {
+        if (! ec)
+        {
+          no_delay(socket);
+          std::make_shared<chat_session<socket_type>>(std::move(socket), room_,
+            filter_, flood_, batching_, tokens_)->start();
+        }
+
+        do_accept();
+      }
+    );
+  }
+
+  typename Protocol::acceptor acceptor_;
+  chat_room& room_;
+  chat_filter_ptr const& filter_;
+  chat_flood& flood_;
+  chat_batching const& batching_;
+  chat_tokens const& tokens_;
+};
+
+// remove the socket file an earlier run left behind at path, anything that
+// is not a socket, or a socket a live server still accepts on, is left for
+// the bind to fail on
+static void remove_stale_socket(boost::asio::io_context& io_context, std::string const& path)
+{
+  struct stat st;
+  if (::lstat(path.c_str(), &st) != 0 || ! S_ISSOCK(st.st_mode))
+  {
+    return;
+  }
+
+  boost::system::error_code ec;
+  local::socket probe {io_context};
+  probe.connect(local::endpoint {path}, ec);
+
+  if (ec == boost::asio::error::connection_refused)
+  {
+    ::unlink(path.c_str());
+  }
+}
+
+// start a new flood detection window and report the metrics of the last one
+static void watch_flood(boost::asio::steady_timer& timer, chat_flood& flood)
+{
+  timer.expires_after(std::chrono::seconds(chat_flood::window));
+  timer.async_wait(
+    [&timer, &flood](boost::system::error_code ec)
+    {
+      if (ec)
+      {
+        return;
+      }
+
+      flood.rotate();
+      flood.metrics().report(std::cerr);
+      flood.metrics().reset();
+
+      watch_flood(timer, flood);
+    }
+  );
+}
+
+// reload the content filter on every SIGHUP, a failed reload keeps the
+// filter that was in use
+static void watch_filter(boost::asio::signal_set& signals, std::string const& path,
+  chat_filter_ptr& filter)
+{
+  signals.async_wait(
+    [&signals, &path, &filter](boost::system::error_code ec, int /*signo*/)
+    {
+      if (ec)
+      {
+        return;
+      }
+
+      try
+      {
+        filter = chat_filter::load(path);
+        std::cerr << "filter: reloaded " << filter->size() << " phrases\n";
+      }
+      catch (std::exception const& e)
+      {
+        std::cerr << "filter: " << e.what() << "\n";
+      }
+
+      watch_filter(signals, path, filter);
+    }
+  );
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    std::string filter_path;
+    bool flood_limits {true};
+    chat_batching batching;
+    chat_tokens tokens;
+    // room name, empty for the default, and port, unix:path or shm:path
+    std::vector<std::pair<std::string, std::string>> listeners;
+    for (int i = 1; i < argc; ++i)
+    {
+      std::string const arg {argv[i]};
+      if (arg == "--filter" && i + 1 < argc)
+      {
+        filter_path = argv[++i];
+      }
+      else if (arg == "--no-flood")
+      {
+        flood_limits = false;
+      }
+      else if (arg == "--batch-window" && i + 1 < argc)
+      {
+        batching.max_window = std::chrono::microseconds(std::atoi(argv[++i]));
+      }
+      else if (arg == "--batch-bytes" && i + 1 < argc)
+      {
+        batching.max_bytes = static_cast<std::size_t>(std::atoi(argv[++i]));
+      }
+      else if (arg == "--watch-token" && i + 1 < argc)
+      {
+        tokens.emplace(argv[++i]);
+      }
+      else
+      {
+        auto const pos = arg.find('@');
+        if (pos == std::string::npos)
+        {
+          listeners.emplace_back(std::string {}, arg);
+        }
+        else
+        {
+          listeners.emplace_back(arg.substr(0, pos), arg.substr(pos + 1));
+        }
+      }
+    }
+
+    if (listeners.empty())
+    {
+      std::cerr << "Usage: chat_server [--filter <file>] [--no-flood] [--batch-window <us>]\n"
+        << "  [--batch-bytes <n>] [--watch-token <token> ...]\n"
+        << "  [room@]<port|unix:path|shm:path> [...]\n"
+        << "  listeners given the same room share it, without one every port\n"
+        << "  has a room of its own, and unix domain sockets and shared memory,\n"
+        << "  set up over the unix domain socket at path, share the room of the\n"
+        << "  first port\n"
+        << "  the flood limits, 100 messages a second and 300 in 10 seconds per\n"
+        << "  user, apply to batch clients too, --no-flood turns them off\n";
+      return 1;
+    }
+
+    boost::asio::io_context io_context;
+
+    // shared by every server, swapped out on reload
+    chat_filter_ptr filter;
+    boost::asio::signal_set signals {io_context};
+    if (! filter_path.empty())
+    {
+      filter = chat_filter::load(filter_path);
+      std::cerr << "filter: loaded " << filter->size() << " phrases\n";
+
+      signals.add(SIGHUP);
+      watch_filter(signals, filter_path, filter);
+    }
+
+    // shared by every server, so a sender is tracked across rooms
+    chat_metrics metrics;
+    chat_flood flood {metrics};
+    flood.enabled(flood_limits);
+    boost::asio::steady_timer flood_timer {io_context};
+    watch_flood(flood_timer, flood);
+
+    auto const is_unix = [](std::string const& address)
+    {
+      return address.compare(0, 5, "unix:") == 0;
+    };
+
+    auto const is_shm = [](std::string const& address)
+    {
+      return address.compare(0, 4, "shm:") == 0;
+    };
+
+    // an unnamed port is its own room, named after the port, and same host
+    // clients skip the tcp stack but talk to the room of the first port
+    std::string first_room;
+    for (auto const& listener : listeners)
+    {
+      if (! is_unix(listener.second) && ! is_shm(listener.second))
+      {
+        first_room = listener.first.empty() ? listener.second : listener.first;
+        break;
+      }
+    }
+
+    chat_rooms rooms {io_context, metrics};
+    std::list<chat_server<tcp>> servers;
+    std::list<chat_server<local>> local_servers;
+    std::list<chat_server<chat_shm_protocol>> shm_servers;
+    for (auto const& listener : listeners)
+    {
+      auto const& address = listener.second;
+      bool const same_host {is_unix(address) || is_shm(address)};
+
+      auto& room = rooms.get(! listener.first.empty() ? listener.first :
+        same_host ? first_room : address);
+
+      if (same_host)
+      {
+        auto const path = address.substr(is_unix(address) ? 5 : 4);
+
+        // a socket file left behind by an earlier run would fail the bind
+        remove_stale_socket(io_context, path);
+
+        if (is_unix(address))
+        {
+          local_servers.emplace_back(io_context, local::endpoint {path}, room,
+            filter, flood, batching, tokens);
+        }
+        else
+        {
+          shm_servers.emplace_back(io_context, local::endpoint {path}, room,
+            filter, flood, batching, tokens);
+        }
+      }
+      else
+      {
+        tcp::endpoint endpoint(tcp::v4(), static_cast<unsigned short>(std::atoi(address.c_str())));
+        servers.emplace_back(io_context, endpoint, room, filter, flood, batching, tokens);
+      }
     }
 
+    std::cerr << "rooms: " << rooms.size() << " for " << listeners.size() << " listeners\n";
+
     io_context.run();
   }
   catch (std::exception& e)
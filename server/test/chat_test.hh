@@ -0,0 +1,157 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CHAT_TEST_HPP
+#define CHAT_TEST_HPP
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <csignal>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// shared by the tests, each one is a program that exits non zero when a
+// check failed, the ones that need a server are given the path to the
+// server binary as their first argument
+
+inline int& chat_test_failures()
+{
+  static int failures {0};
+  return failures;
+}
+
+inline void check(bool ok, std::string const& what)
+{
+  if (! ok)
+  {
+    ++chat_test_failures();
+    std::cerr << "FAIL: " << what << "\n";
+  }
+}
+
+inline int chat_test_result()
+{
+  return chat_test_failures() ? 1 : 0;
+}
+
+// a port of its own for every test, derived from the pid so tests run in
+// parallel don't collide
+inline unsigned short chat_test_port(unsigned short offset)
+{
+  return static_cast<unsigned short>(20000 + (::getpid() % 8000) * 5 + offset);
+}
+
+// run the io_context until done returns true, false on timeout
+inline bool chat_test_run(boost::asio::io_context& io_context, std::function<bool()> const& done,
+  std::chrono::milliseconds timeout = std::chrono::seconds(10))
+{
+  auto const deadline = std::chrono::steady_clock::now() + timeout;
+  while (! done())
+  {
+    if (std::chrono::steady_clock::now() >= deadline)
+    {
+      return false;
+    }
+
+    io_context.restart();
+    io_context.run_for(std::chrono::milliseconds(10));
+  }
+
+  return true;
+}
+
+// a server process, its log goes to /dev/null
+class chat_test_server
+{
+public:
+
+  chat_test_server(std::string binary, std::vector<std::string> args) :
+    binary_ {std::move(binary)},
+    args_ {std::move(args)}
+  {
+  }
+
+  chat_test_server(chat_test_server const&) = delete;
+  chat_test_server& operator=(chat_test_server const&) = delete;
+
+  ~chat_test_server()
+  {
+    kill();
+  }
+
+  // start the server and wait until it accepts on port
+  bool start(unsigned short port)
+  {
+    pid_ = ::fork();
+    if (pid_ < 0)
+    {
+      return false;
+    }
+
+    if (pid_ == 0)
+    {
+      int const null {::open("/dev/null", O_WRONLY)};
+      ::dup2(null, STDERR_FILENO);
+
+      std::vector<char*> argv;
+      argv.emplace_back(const_cast<char*>(binary_.c_str()));
+      for (auto const& arg : args_)
+      {
+        argv.emplace_back(const_cast<char*>(arg.c_str()));
+      }
+      argv.emplace_back(nullptr);
+
+      ::execv(binary_.c_str(), argv.data());
+      ::_exit(127);
+    }
+
+    boost::asio::io_context io_context;
+    boost::asio::ip::tcp::endpoint const endpoint {
+      boost::asio::ip::address_v4::loopback(), port};
+
+    for (std::size_t i = 0; i < 500; ++i)
+    {
+      boost::system::error_code ec;
+      boost::asio::ip::tcp::socket probe {io_context};
+      probe.connect(endpoint, ec);
+      if (! ec)
+      {
+        return true;
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    return false;
+  }
+
+  // SIGKILL, to the clients the server crashed
+  void kill()
+  {
+    if (pid_ > 0)
+    {
+      ::kill(pid_, SIGKILL);
+      ::waitpid(pid_, nullptr, 0);
+      pid_ = -1;
+    }
+  }
+
+private:
+
+  std::string binary_;
+  std::vector<std::string> args_;
+  pid_t pid_ {-1};
+};
+
+#endif // CHAT_TEST_HPP
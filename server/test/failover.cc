@@ -0,0 +1,112 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "chat_test.hh"
+
+#include "chat_client.hh"
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// a client given several servers, one of them down, connects to a live
+// one, and fails over to the other as soon as the one it picked is killed
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: failover_test <server>\n";
+    return 1;
+  }
+
+  using clock = std::chrono::steady_clock;
+
+  // nothing listens on the first port
+  auto const dead = chat_test_port(0);
+  unsigned short const ports[] {chat_test_port(1), chat_test_port(2)};
+
+  chat_test_server first {argv[1], {"--no-flood", std::to_string(static_cast<unsigned>(ports[0]))}};
+  chat_test_server second {argv[1], {"--no-flood", std::to_string(static_cast<unsigned>(ports[1]))}};
+  if (! first.start(ports[0]) || ! second.start(ports[1]))
+  {
+    std::cerr << "FAIL: servers did not start\n";
+    return 1;
+  }
+
+  auto const loopback = boost::asio::ip::address_v4::loopback();
+  chat_client::endpoints_type const endpoints {
+    {loopback, dead}, {loopback, ports[0]}, {loopback, ports[1]}};
+
+  boost::asio::io_context io_context;
+  chat_client client {io_context};
+  client.ping_interval(std::chrono::milliseconds(0));
+
+  std::vector<unsigned short> connected;
+  clock::time_point lost;
+  clock::time_point found;
+  std::size_t echoed {0};
+
+  client.on_connect([&](chat_client::endpoint_type const& endpoint, std::size_t /*us*/)
+    {
+      connected.emplace_back(endpoint.port());
+      found = clock::now();
+    }
+  );
+  client.on_disconnect([&](std::size_t) { lost = clock::now(); });
+  client.on_msg([&](chat_msg_view const& msg) { echoed += msg.user == "alice" && msg.id; });
+
+  client.login("alice", "hunter2");
+  client.connect(endpoints);
+
+  for (std::size_t i = 0; i < 5; ++i)
+  {
+    client.msg("first server " + std::to_string(i));
+  }
+
+  check(chat_test_run(io_context, [&]() { return echoed == 5; }),
+    "echoes from the first pick: " + std::to_string(echoed));
+  check(connected.size() == 1 && connected.front() != dead, "picked the dead server");
+
+  if (connected.size() != 1)
+  {
+    return chat_test_result();
+  }
+
+  // kill the one it picked, the other is still up
+  bool const picked_first {connected.front() == ports[0]};
+  (picked_first ? first : second).kill();
+
+  check(chat_test_run(io_context, [&]() { return connected.size() == 2; }),
+    "did not fail over");
+
+  for (std::size_t i = 0; i < 5; ++i)
+  {
+    client.msg("second server " + std::to_string(i));
+  }
+
+  check(chat_test_run(io_context, [&]() { return echoed == 10 && client.unacked() == 0; }),
+    "echoes after failing over: " + std::to_string(echoed));
+
+  if (connected.size() == 2)
+  {
+    check(connected.back() == (picked_first ? ports[1] : ports[0]),
+      "failed over to " + std::to_string(static_cast<unsigned>(connected.back())));
+
+    // a connection that was up fails over without waiting on the backoff
+    auto const took = std::chrono::duration_cast<std::chrono::milliseconds>(found - lost);
+    check(took.count() < 500, "failover took " + std::to_string(took.count()) + "ms");
+  }
+
+  bool closed {false};
+  client.on_close([&]() { closed = true; });
+  client.close();
+  check(chat_test_run(io_context, [&]() { return closed; }), "close did not finish");
+
+  return chat_test_result();
+}
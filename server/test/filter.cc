@@ -0,0 +1,271 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "chat_test.hh"
+
+#include "chat_filter.hh"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// the aho-corasick automaton finds what a plain search for every phrase
+// finds, overlapping phrases, phrases that end other phrases, matches at the
+// end of the text, in any ascii case, and nothing at all without phrases
+
+using action = chat_filter::action;
+using phrases = std::vector<std::pair<std::string, action>>;
+
+static std::shared_ptr<chat_filter const> compile(phrases const& list)
+{
+  auto filter = std::make_shared<chat_filter>();
+  for (auto const& p : list)
+  {
+    filter->add(p.first, p.second);
+  }
+  filter->build();
+
+  return filter;
+}
+
+static char lower(char c)
+{
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+static bool matches_at(std::string const& text, std::size_t at, std::string const& phrase)
+{
+  if (phrase.empty() || at + phrase.size() > text.size())
+  {
+    return false;
+  }
+
+  for (std::size_t i = 0; i < phrase.size(); ++i)
+  {
+    if (lower(text[at + i]) != lower(phrase[i]))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// every phrase searched for at every position
+static action naive_check(phrases const& list, std::string const& text)
+{
+  auto act = action::none;
+  for (auto const& p : list)
+  {
+    for (std::size_t at = 0; at < text.size(); ++at)
+    {
+      if (matches_at(text, at, p.first))
+      {
+        act = std::max(act, p.second);
+      }
+    }
+  }
+
+  return act;
+}
+
+static std::string naive_mask(phrases const& list, std::string const& text)
+{
+  auto str = text;
+  for (auto const& p : list)
+  {
+    if (p.second < action::mask)
+    {
+      continue;
+    }
+
+    for (std::size_t at = 0; at < text.size(); ++at)
+    {
+      if (matches_at(text, at, p.first))
+      {
+        std::fill_n(str.begin() + static_cast<std::ptrdiff_t>(at), p.first.size(), '*');
+      }
+    }
+  }
+
+  return str;
+}
+
+static char const* name(action act)
+{
+  switch (act)
+  {
+    case action::none: return "none";
+    case action::flag: return "flag";
+    case action::mask: return "mask";
+    case action::block: return "block";
+    default: return "?";
+  }
+}
+
+static void expect(phrases const& list, std::string const& text, action act, std::string const& masked)
+{
+  auto const filter = compile(list);
+
+  auto const found = filter->check(text);
+  check(found == act, "'" + text + "' checked " + name(found) + " instead of " + name(act));
+
+  auto const str = filter->mask(text);
+  check(str == masked, "'" + text + "' masked '" + str + "' instead of '" + masked + "'");
+
+  // and the plain search agrees
+  check(naive_check(list, text) == act, "'" + text + "' plain search disagrees");
+  check(naive_mask(list, text) == masked, "'" + text + "' plain mask disagrees");
+}
+
+static void cases()
+{
+  // overlapping phrases, and a phrase overlapping itself
+  expect({{"abc", action::mask}, {"bcd", action::mask}}, "xabcdx", action::mask, "x****x");
+  expect({{"abc", action::flag}, {"bcd", action::block}}, "abcd", action::block, "a***");
+  expect({{"aa", action::mask}}, "aaaa", action::mask, "****");
+  expect({{"aba", action::mask}}, "ababa", action::mask, "*****");
+
+  // phrases that are suffixes of others, found through the fail links
+  expect({{"she", action::flag}, {"he", action::block}}, "she", action::block, "s**");
+  expect({{"he", action::mask}, {"hers", action::mask}}, "ushers", action::mask, "us****");
+  expect({{"abcx", action::flag}, {"bc", action::mask}}, "abcd", action::mask, "a**d");
+  expect({{"bcd", action::mask}, {"abcde", action::flag}}, "abcdf", action::mask, "a***f");
+  expect({{"ab", action::mask}, {"abcd", action::mask}}, "xabcdx", action::mask, "x****x");
+
+  // at the very end, the very start, and the whole text
+  expect({{"bad", action::block}}, "this is bad", action::block, "this is ***");
+  expect({{"bad", action::mask}}, "bad start", action::mask, "*** start");
+  expect({{"bad", action::mask}}, "bad", action::mask, "***");
+  expect({{"bad", action::mask}}, "ba", action::none, "ba");
+  expect({{"bad", action::mask}}, "", action::none, "");
+
+  // ascii case folding both ways, other bytes are left alone
+  expect({{"BaD", action::mask}}, "bAd and BAD", action::mask, "*** and ***");
+  expect({{"caf\xc3\xa9", action::mask}}, "CAF\xc3\xa9", action::mask, "*****");
+  expect({{"\xc3\xa9", action::block}}, "\xc3\x89", action::none, "\xc3\x89");
+
+  // a flagged phrase is reported but never masked
+  expect({{"bad", action::flag}}, "so bad", action::flag, "so bad");
+
+  // the same phrase twice takes the more severe action
+  expect({{"bad", action::flag}, {"BAD", action::mask}}, "bad", action::mask, "***");
+
+  // no phrases, and empty phrases which are ignored
+  expect({}, "anything at all", action::none, "anything at all");
+  expect({{"", action::block}}, "anything", action::none, "anything");
+
+  {
+    chat_filter filter;
+    filter.add("", action::block);
+    filter.build();
+    check(filter.size() == 0, "empty phrase counted");
+    check(filter.check("text") == action::none, "empty filter matched");
+  }
+}
+
+// random phrases and texts over a small alphabet, so matches, overlaps and
+// shared suffixes are common
+static void random_cases()
+{
+  std::mt19937 rng {64};
+  std::string const alphabet {"abAB c"};
+  std::uniform_int_distribution<std::size_t> letter {0, alphabet.size() - 1};
+  std::uniform_int_distribution<std::size_t> count {0, 8};
+  std::uniform_int_distribution<std::size_t> phrase_length {1, 5};
+  std::uniform_int_distribution<std::size_t> text_length {0, 40};
+  std::uniform_int_distribution<int> act {1, 3};
+
+  auto const random = [&](std::size_t length)
+  {
+    std::string str;
+    for (std::size_t i = 0; i < length; ++i)
+    {
+      str += alphabet[letter(rng)];
+    }
+    return str;
+  };
+
+  for (std::size_t round = 0; round < 500; ++round)
+  {
+    phrases list;
+    auto const n = count(rng);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      list.emplace_back(random(phrase_length(rng)), static_cast<action>(act(rng)));
+    }
+
+    auto const filter = compile(list);
+    for (std::size_t i = 0; i < 20; ++i)
+    {
+      auto const text = random(text_length(rng));
+      check(filter->check(text) == naive_check(list, text),
+        "round " + std::to_string(round) + " check of '" + text + "'");
+      check(filter->mask(text) == naive_mask(list, text),
+        "round " + std::to_string(round) + " mask of '" + text + "'");
+    }
+  }
+}
+
+static void files()
+{
+  auto const path = "/tmp/chat_filter_test." + std::to_string(::getpid());
+
+  {
+    std::ofstream out {path};
+    out << "# comments and blank lines are skipped\n"
+      << "\n"
+      << "block spam\r\n"
+      << "mask darn it\n"
+      << "flag meh\n"
+      << "shout loud\n"
+      << "nophrase\n";
+  }
+
+  auto const filter = chat_filter::load(path);
+  check(filter->size() == 3, "phrases loaded: " + std::to_string(filter->size()));
+  check(filter->check("buy SPAM") == action::block, "loaded block phrase");
+  check(filter->mask("oh darn it all") == "oh ******* all", "loaded mask phrase with a space");
+  check(filter->check("meh") == action::flag, "loaded flag phrase");
+  check(filter->check("loud") == action::none, "unknown action loaded");
+
+  {
+    // nothing but comments is an empty filter
+    std::ofstream out {path};
+    out << "# nothing yet\n";
+  }
+
+  auto const empty = chat_filter::load(path);
+  check(empty->size() == 0, "phrases in an empty file: " + std::to_string(empty->size()));
+  check(empty->check("spam") == action::none && empty->mask("spam") == "spam",
+    "empty file matched");
+
+  std::remove(path.c_str());
+
+  bool thrown {false};
+  try
+  {
+    chat_filter::load(path);
+  }
+  catch (std::runtime_error const&)
+  {
+    thrown = true;
+  }
+  check(thrown, "a missing file did not throw");
+}
+
+int main()
+{
+  cases();
+  random_cases();
+  files();
+
+  return chat_test_result();
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "chat_test.hh"
+
+#include "chat_flood.hh"
+#include "chat_metrics.hh"
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+// flood detection at a realistic volume, about 20k messages per window
+// across the server, must leave ordinary senders alone and still catch
+// a repeating sender and a heavy hitter
+
+static std::string text(std::size_t i)
+{
+  return "message number " + std::to_string(i * 7919) + " about thing " +
+    std::to_string(i % 97) + " and " + std::to_string(i);
+}
+
+int main()
+{
+  {
+    // one message from each of many senders
+    chat_metrics metrics;
+    chat_flood flood {metrics};
+
+    std::size_t flagged {0};
+    for (std::size_t i = 0; i < 20000; ++i)
+    {
+      flagged += flood.observe("user" + std::to_string(i), text(i));
+    }
+
+    check(flagged == 0, "distinct senders flagged: " + std::to_string(flagged));
+  }
+
+  {
+    // chatty senders, ten different messages each
+    chat_metrics metrics;
+    chat_flood flood {metrics};
+
+    std::size_t flagged {0};
+    for (std::size_t i = 0; i < 20000; ++i)
+    {
+      flagged += flood.observe("user" + std::to_string(i % 2000), text(i));
+    }
+
+    check(flagged == 0, "chatty senders flagged: " + std::to_string(flagged));
+
+    // the same text over and over is caught at that volume
+    bool repeats {false};
+    for (std::size_t i = 0; i < 30 && ! repeats; ++i)
+    {
+      repeats = flood.observe("spammer", "buy cheap stuff now");
+    }
+
+    check(repeats, "repeating sender not flagged");
+
+    // as is a sender over the per window limit
+    bool heavy {false};
+    for (std::size_t i = 0; i < 2 * chat_flood::max_msgs && ! heavy; ++i)
+    {
+      heavy = flood.observe("hitter", text(i));
+    }
+
+    check(heavy, "heavy hitter not flagged");
+  }
+
+  return chat_test_result();
+}
@@ -0,0 +1,137 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "chat_test.hh"
+
+#include "chat_client.hh"
+
+#include <boost/asio.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+// text that is not valid utf-8 is refused by the client before it gets an
+// id, a frame the server can not parse is answered with an error that
+// carries its id when one can be found, and otherwise ends the connection
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: malformed_test <server>\n";
+    return 1;
+  }
+
+  auto const port = chat_test_port(0);
+  chat_test_server server {argv[1], {"--no-flood", std::to_string(static_cast<unsigned>(port))}};
+  if (! server.start(port))
+  {
+    std::cerr << "FAIL: server did not start\n";
+    return 1;
+  }
+
+  {
+    // the client refuses invalid text before it takes an id
+    boost::asio::io_context io_context;
+    chat_client client {io_context};
+    client.ping_interval(std::chrono::milliseconds(0));
+
+    std::size_t logins {0};
+    std::size_t echoed {0};
+
+    client.on_srv([&](chat_srv_view const& srv) { logins += srv.login; });
+    client.on_msg([&](chat_msg_view const& msg) { echoed += msg.user == "alice" && msg.id; });
+
+    client.login("alice", "hunter2");
+    client.connect({{boost::asio::ip::address_v4::loopback(), port}});
+
+    check(chat_test_run(io_context, [&]() { return logins == 1; }), "login not confirmed");
+
+    check(client.msg("caf\xe9") == 0, "invalid utf-8 room message was given an id");
+    check(! client.prv("rabbit", "caf\xe9"), "invalid utf-8 private message was queued");
+    check(client.msg("caf\xc3\xa9") == 1, "valid utf-8 room message did not get the first id");
+
+    check(chat_test_run(io_context, [&]() { return echoed == 1 && client.unacked() == 0; }),
+      "valid message not echoed");
+
+    bool closed {false};
+    client.on_close([&]() { closed = true; });
+    client.close();
+    check(chat_test_run(io_context, [&]() { return closed; }), "close did not finish");
+  }
+
+  {
+    // frames the client would never send, straight over a socket
+    boost::asio::io_context io_context;
+    boost::asio::ip::tcp::socket socket {io_context};
+    socket.connect({boost::asio::ip::address_v4::loopback(), port});
+
+    // a server that stops answering fails the reads instead of hanging
+    timeval const timeout {5, 0};
+    ::setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    auto const send = [&socket](std::string const& body)
+    {
+      chat_message const frame {body};
+      boost::asio::write(socket, boost::asio::buffer(frame.data(), frame.length()));
+    };
+
+    // the next srv frame, false once the connection is gone
+    chat_reader reader;
+    chat_message frame;
+    auto const receive = [&]()
+    {
+      for (;;)
+      {
+        boost::system::error_code ec;
+        boost::asio::read(socket, boost::asio::buffer(frame.data(), chat_message::header_length), ec);
+        if (ec || ! frame.decode_header())
+        {
+          return false;
+        }
+
+        boost::asio::read(socket, boost::asio::buffer(frame.body(), frame.body_length()), ec);
+        if (ec)
+        {
+          return false;
+        }
+
+        if (reader.parse(frame.body(), frame.body_length()) && reader.type() == chat_type::srv)
+        {
+          return true;
+        }
+      }
+    };
+
+    send("{\"type\":\"auth\",\"user\":\"rabbit\",\"pass\":\"verylate\"}");
+    bool logged_in {false};
+    while (! logged_in && receive())
+    {
+      logged_in = reader.get<chat_srv>().seq.set;
+    }
+    check(logged_in, "raw login not confirmed");
+
+    // the server finds the id despite the bad text, and keeps the connection
+    send("{\"type\":\"msg\",\"msg\":\"caf\xe9\",\"id\":42}");
+    check(receive(), "no reply to the bad text");
+    auto res = reader.get<chat_srv>();
+    check(res.str.starts_with("Error: malformed"), "reply to the bad text: " + res.str.to_string());
+    check(res.id.set && res.id.value == 42, "error carried id " + std::to_string(res.id.value));
+
+    // no id to report back, the server ends the connection
+    send("{\"type\":\"msg\",\"msg\":\"cut short\"");
+    check(receive(), "connection ended without an error for the cut short frame");
+    res = reader.get<chat_srv>();
+    check(res.str.starts_with("Error: malformed") && ! res.id.set,
+      "reply to the cut short frame: " + res.str.to_string());
+    check(! receive(), "connection kept after a frame without an id");
+  }
+
+  return chat_test_result();
+}
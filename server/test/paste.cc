@@ -0,0 +1,126 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "chat_test.hh"
+
+#include "chat_client.hh"
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// pastes far larger than a frame are split by the sender and arrive whole
+// at another client, the throughput of each size is reported
+
+// text with multi byte characters and characters that need escaping, so
+// the split has to respect both
+static std::string paste(std::size_t size)
+{
+  static std::string const words[] {"plain ", "quoted \"text\" ", "caf\xc3\xa9 ",
+    "\xe2\x82\xac" "42 ", "tab\there ", "\xf0\x9f\x98\x80 ", "back\\slash "};
+
+  std::string text;
+  for (std::size_t i = 0; text.size() < size; ++i)
+  {
+    text += words[i % (sizeof(words) / sizeof(words[0]))];
+  }
+
+  return text;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: paste_test <server>\n";
+    return 1;
+  }
+
+  using clock = std::chrono::steady_clock;
+
+  auto const port = chat_test_port(0);
+  chat_test_server server {argv[1], {"--no-flood", std::to_string(static_cast<unsigned>(port))}};
+  if (! server.start(port))
+  {
+    std::cerr << "FAIL: server did not start\n";
+    return 1;
+  }
+
+  chat_client::endpoints_type const endpoints {{boost::asio::ip::address_v4::loopback(), port}};
+
+  boost::asio::io_context io_context;
+  chat_client sender {io_context};
+  chat_client receiver {io_context};
+  sender.ping_interval(std::chrono::milliseconds(0));
+  receiver.ping_interval(std::chrono::milliseconds(0));
+
+  std::size_t logins {0};
+  std::vector<std::string> received;
+  clock::time_point arrival;
+
+  sender.on_srv([&](chat_srv_view const& srv) { logins += srv.login; });
+  receiver.on_srv([&](chat_srv_view const& srv) { logins += srv.login; });
+  receiver.on_msg([&](chat_msg_view const& msg)
+    {
+      if (msg.user == "alice")
+      {
+        received.emplace_back(msg.msg.to_string());
+        arrival = clock::now();
+      }
+    }
+  );
+
+  sender.login("alice", "hunter2");
+  receiver.login("rabbit", "verylate");
+  sender.connect(endpoints);
+  receiver.connect(endpoints);
+
+  check(chat_test_run(io_context, [&]() { return logins == 2; }), "logins not confirmed");
+
+  std::size_t const sizes[] {4096, 65536, 1 << 20};
+  for (auto const size : sizes)
+  {
+    auto const text = paste(size);
+    received.clear();
+
+    auto const start = clock::now();
+    sender.msg(text);
+
+    bool const arrived {chat_test_run(io_context, [&]() { return ! received.empty(); })};
+    auto const took = std::chrono::duration_cast<std::chrono::microseconds>(arrival - start);
+
+    check(arrived, "paste of " + std::to_string(text.size()) + " bytes never arrived");
+    if (! arrived)
+    {
+      continue;
+    }
+
+    check(received.size() == 1 && received.front() == text,
+      "paste of " + std::to_string(text.size()) + " bytes arrived as " +
+      std::to_string(received.front().size()) + " bytes");
+
+    char line[128];
+    std::snprintf(line, sizeof(line), "paste: %8zu bytes in %8.2fms, %7.2f MB/s\n",
+      text.size(), static_cast<double>(took.count()) / 1000.0,
+      static_cast<double>(text.size()) / static_cast<double>(std::max<std::int64_t>(1, took.count())));
+    std::cout << line;
+  }
+
+  std::size_t closed {0};
+  sender.on_close([&]() { ++closed; });
+  receiver.on_close([&]() { ++closed; });
+  sender.close();
+  receiver.close();
+  check(chat_test_run(io_context, [&]() { return closed == 2; }), "close did not finish");
+
+  return chat_test_result();
+}
@@ -0,0 +1,276 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "chat_test.hh"
+
+#include "chat_proto.hh"
+
+#include "json.hh"
+using Json = nlohmann::json;
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// every message written by chat_writer reads back the same through
+// chat_reader, and the reader takes and refuses the same bodies as
+// nlohmann::json, which the reader replaced
+
+// text with every kind of character the writer escapes
+static std::string const awkward {"quote \" back\\slash \b\f\n\r\t \x01\x1f"
+  " caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 / end"};
+
+template<typename T>
+static T round_trip(T const& msg, chat_reader& reader, std::string& body)
+{
+  body = chat_dump(msg);
+  check(! body.empty(), std::string {chat_type_name(T::type)} + " did not fit");
+  check(reader.parse(body.data(), body.size()),
+    std::string {chat_type_name(T::type)} + " did not read back: " + body);
+  check(reader.type() == T::type, std::string {chat_type_name(T::type)} + " read back as " +
+    chat_type_name(reader.type()));
+
+  // the same document for nlohmann::json
+  auto const j = Json::parse(body);
+  check(j.at("type") == chat_type_name(T::type), "nlohmann read another type: " + body);
+
+  return reader.get<T>();
+}
+
+static void round_trips()
+{
+  chat_reader reader;
+  std::string body;
+
+  {
+    chat_auth msg;
+    msg.user = "alice";
+    msg.pass = awkward;
+    msg.since = UINT64_MAX;
+    msg.acks = 1;
+    auto const res = round_trip(msg, reader, body);
+    check(res.user == msg.user && res.pass == msg.pass && res.since == msg.since &&
+      res.acks == msg.acks, "auth: " + body);
+  }
+
+  {
+    chat_watch msg;
+    msg.token = "t0k3n";
+    msg.since = 17;
+    msg.lossy = 1;
+    auto const res = round_trip(msg, reader, body);
+    check(res.token == msg.token && res.since == msg.since && res.lossy == msg.lossy,
+      "watch: " + body);
+  }
+
+  {
+    chat_msg msg;
+    msg.user = "alice";
+    msg.msg = awkward;
+    msg.id = 42;
+    msg.seq = 1ULL << 40;
+    msg.part = 3;
+    msg.parts = 4;
+    auto const res = round_trip(msg, reader, body);
+    check(res.user == msg.user && res.msg == msg.msg && res.id == msg.id &&
+      res.seq == msg.seq && res.part == msg.part && res.parts == msg.parts, "msg: " + body);
+
+    // the escapes are the ones nlohmann::json writes
+    std::string const escaped {"\"quote \\\" back\\\\slash \\b\\f\\n\\r\\t \\u0001\\u001f"
+      " caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 / end\""};
+    check(Json::parse(body).at("msg").get<std::string>() == awkward, "msg text: " + body);
+    check(body.find(escaped) != std::string::npos, "msg escapes: " + body);
+  }
+
+  {
+    // empty strings and zero numbers are left out
+    chat_msg msg;
+    msg.msg = "x";
+    auto const res = round_trip(msg, reader, body);
+    check(body == "{\"type\":\"msg\",\"msg\":\"x\"}", "msg defaults: " + body);
+    check(res.user.empty() && res.id == 0 && res.seq == 0, "msg defaults read back: " + body);
+  }
+
+  {
+    chat_prv msg;
+    msg.to = "rabbit";
+    msg.from = "alice";
+    msg.msg = awkward;
+    auto const res = round_trip(msg, reader, body);
+    check(res.to == msg.to && res.from == msg.from && res.msg == msg.msg, "prv: " + body);
+  }
+
+  {
+    // a set option is written even when it is zero
+    chat_srv msg;
+    msg.str = "Success: logged in";
+    msg.seq = 0;
+    auto const res = round_trip(msg, reader, body);
+    check(res.str == msg.str && res.seq.set && res.seq.value == 0 && ! res.id.set,
+      "srv: " + body);
+  }
+
+  {
+    chat_ping msg;
+    msg.t = 1234567890123ULL;
+    auto const res = round_trip(msg, reader, body);
+    check(res.t == msg.t, "ping: " + body);
+  }
+
+  {
+    chat_pong msg;
+    msg.t = 1;
+    auto const res = round_trip(msg, reader, body);
+    check(res.t == msg.t, "pong: " + body);
+  }
+
+  {
+    chat_sub msg;
+    msg.mentions = 1;
+    msg.from = "alice,rabbit";
+    msg.words = "tea,caf\xc3\xa9";
+    auto const res = round_trip(msg, reader, body);
+    check(res.mentions == msg.mentions && res.from == msg.from && res.words == msg.words,
+      "sub: " + body);
+  }
+
+  {
+    chat_ack msg;
+    msg.id = 7;
+    msg.seq = 8;
+    msg.ts = 9;
+    auto const res = round_trip(msg, reader, body);
+    check(res.id == msg.id && res.seq == msg.seq && res.ts == msg.ts, "ack: " + body);
+  }
+
+  {
+    // too long for a frame
+    chat_msg msg;
+    std::string const text(chat_message::max_body_length, 'x');
+    msg.msg = text;
+    check(chat_dump(msg).empty(), "a message longer than a frame was written");
+    check(chat_length(msg) > chat_message::max_body_length, "length of a long message");
+  }
+}
+
+// whether nlohmann::json takes the body as a single object
+static bool nlohmann_accepts(std::string const& body)
+{
+  try
+  {
+    return Json::parse(body).is_object();
+  }
+  catch (...)
+  {
+    return false;
+  }
+}
+
+static void parses(std::string const& body, bool expected)
+{
+  chat_reader reader;
+  auto const ok = reader.parse(body.data(), body.size());
+  check(ok == expected, (expected ? "refused: " : "accepted: ") + body);
+  check(nlohmann_accepts(body) == expected, "nlohmann disagrees on: " + body);
+}
+
+static void malformed()
+{
+  // nested values are checked, not only counted
+  parses("{\"a\":{,\"msg\"false}}", false);
+  parses("{\"a\":[-1null]}", false);
+  parses("{\"a\":[1,]}", false);
+  parses("{\"a\":[,1]}", false);
+  parses("{\"a\":{\"b\"}}", false);
+  parses("{\"a\":{\"b\":}}", false);
+  parses("{\"a\":{\"b\":1,}}", false);
+  parses("{\"a\":{1:2}}", false);
+  parses("{\"a\":[1 2]}", false);
+  parses("{\"a\":[tru]}", false);
+  parses("{\"a\":[\"caf\xe9\"]}", false);
+  parses("{\"a\":[}", false);
+  parses("{\"a\":{]}", false);
+  parses("{\"a\":[[[]]}", false);
+  parses("{\"a\":[01]}", false);
+
+  parses("{\"a\":{},\"b\":[],\"c\":[[],{}]}", true);
+  parses("{\"a\":{\"b\":[1,-2.5e3,true,false,null,\"x\\n\",{\"c\":{}}]}}", true);
+  parses("{ \"a\" : [ 1 , { \"b\" : null } ] , \"type\" : \"msg\" }", true);
+
+  // numbers that overflow a double
+  parses("{\"a\":1e3001}", false);
+  parses("{\"a\":-1e3001}", false);
+  parses("{\"a\":[1.8e308]}", false);
+  parses("{\"a\":1e308}", true);
+  parses("{\"a\":1e-3001}", true);
+  parses("{\"a\":18446744073709551616}", true);
+
+  // numbers that are not json
+  parses("{\"a\":1.}", false);
+  parses("{\"a\":.5}", false);
+  parses("{\"a\":1e}", false);
+  parses("{\"a\":+1}", false);
+  parses("{\"a\":-}", false);
+
+  // top level
+  parses("", false);
+  parses("[]", false);
+  parses("{}", true);
+  parses("{} {}", false);
+  parses("{\"a\":1", false);
+  parses("{\"a\" 1}", false);
+  parses("{\"a\":\"\\x\"}", false);
+  parses("{\"a\":\"\\udc00\"}", false);
+  parses("{\"a\":\"\\ud83d\\ude00\"}", true);
+  parses(std::string {"{\"a\":\"x\x01\"}"}, false);
+
+  {
+    // nesting is limited, deeper than that is refused
+    auto const nested = [](std::size_t depth)
+    {
+      return "{\"a\":" + std::string(depth, '[') + std::string(depth, ']') + "}";
+    };
+
+    chat_reader reader;
+    auto body = nested(chat_reader::max_depth);
+    check(reader.parse(body.data(), body.size()), "refused nesting at the limit");
+    body = nested(chat_reader::max_depth + 1);
+    check(! reader.parse(body.data(), body.size()), "accepted nesting past the limit");
+  }
+
+  {
+    // strings decoded inside nested values leave the top level ones intact
+    chat_reader reader;
+    std::string const body {"{\"a\":[\"x\\n\",{\"b\":\"\\u00e9\"}],\"type\":\"msg\",\"msg\":\"y\\t\"}"};
+    check(reader.parse(body.data(), body.size()), "refused escapes in nested values");
+    check(reader.type() == chat_type::msg && reader.get<chat_msg>().msg == "y\t",
+      "top level string after nested escapes");
+  }
+
+  {
+    chat_reader reader;
+    std::string const body(chat_message::max_body_length + 1, ' ');
+    check(! reader.parse(body.data(), body.size()), "accepted a body longer than a frame");
+  }
+}
+
+static void salvage()
+{
+  check(chat_salvage_id("{\"type\":\"msg\",\"msg\":\"caf\xe9\",\"id\":42}") == 42, "salvage id");
+  check(chat_salvage_id("{\"id\" : 7 ,\"msg\":") == 7, "salvage id with spaces");
+  check(chat_salvage_id("{\"msg\":\"x\\\",\\\"id\\\":9\"") == 0, "salvaged an id from a string");
+  check(chat_salvage_id("{\"msg\":\"cut short\"") == 0, "salvaged a missing id");
+  check(chat_salvage_id("{\"id\":\"5\"}") == 0, "salvaged a string id");
+  check(chat_salvage_id("{\"id\":184467440737095516160}") == 0, "salvaged an id that overflows");
+}
+
+int main()
+{
+  round_trips();
+  malformed();
+  salvage();
+
+  return chat_test_result();
+}
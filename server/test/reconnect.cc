@@ -0,0 +1,112 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "chat_test.hh"
+
+#include "chat_client.hh"
+
+#include <boost/asio.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// a client rides out a server that is killed and restarted, it logs back
+// in and replays what the dead server never echoed, and a refused login
+// closes the client instead of retrying forever
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: reconnect_test <server>\n";
+    return 1;
+  }
+
+  auto const port = chat_test_port(0);
+  chat_test_server server {argv[1], {"--no-flood", std::to_string(static_cast<unsigned>(port))}};
+  if (! server.start(port))
+  {
+    std::cerr << "FAIL: server did not start\n";
+    return 1;
+  }
+
+  chat_client::endpoints_type const endpoints {{boost::asio::ip::address_v4::loopback(), port}};
+
+  {
+    boost::asio::io_context io_context;
+    chat_client client {io_context};
+    client.ping_interval(std::chrono::milliseconds(0));
+
+    std::size_t logins {0};
+    std::size_t connects {0};
+    std::size_t disconnects {0};
+    std::size_t echoed {0};
+
+    client.on_srv([&](chat_srv_view const& srv) { logins += srv.login; });
+    client.on_connect([&](chat_client::endpoint_type const&, std::size_t) { ++connects; });
+    client.on_disconnect([&](std::size_t) { ++disconnects; });
+    client.on_msg([&](chat_msg_view const& msg) { echoed += msg.user == "alice" && msg.id; });
+
+    client.login("alice", "hunter2");
+    client.connect(endpoints);
+
+    for (std::size_t i = 0; i < 10; ++i)
+    {
+      client.msg("before the crash " + std::to_string(i));
+    }
+
+    check(chat_test_run(io_context, [&]() { return echoed == 10; }),
+      "echoes before the crash: " + std::to_string(echoed));
+
+    server.kill();
+    check(chat_test_run(io_context, [&]() { return disconnects > 0; }),
+      "disconnect not noticed");
+
+    // queued while the server is down, replayed once it is back
+    for (std::size_t i = 0; i < 10; ++i)
+    {
+      client.msg("during the outage " + std::to_string(i));
+    }
+
+    check(server.start(port), "server did not restart");
+
+    check(chat_test_run(io_context, [&]() { return echoed == 20 && client.unacked() == 0; }),
+      "echoes after the restart: " + std::to_string(echoed) +
+      ", unacked: " + std::to_string(client.unacked()));
+    check(logins == 2, "logins: " + std::to_string(logins));
+    check(connects >= 2, "connects: " + std::to_string(connects));
+
+    bool closed {false};
+    client.on_close([&]() { closed = true; });
+    client.close();
+    check(chat_test_run(io_context, [&]() { return closed; }), "close did not finish");
+  }
+
+  {
+    // a wrong password is refused once, the client gives up
+    boost::asio::io_context io_context;
+    chat_client client {io_context};
+    client.ping_interval(std::chrono::milliseconds(0));
+
+    std::size_t connects {0};
+    std::size_t refused {0};
+    bool closed {false};
+
+    client.on_connect([&](chat_client::endpoint_type const&, std::size_t) { ++connects; });
+    client.on_srv([&](chat_srv_view const& srv) { refused += srv.str.starts_with("Error"); });
+    client.on_close([&]() { closed = true; });
+
+    client.login("alice", "wrong");
+    client.connect(endpoints);
+
+    check(chat_test_run(io_context, [&]() { return closed; }, std::chrono::seconds(3)),
+      "refused login kept the client open");
+    check(connects == 1, "connects after a refused login: " + std::to_string(connects));
+    check(refused == 1, "refusals: " + std::to_string(refused));
+  }
+
+  return chat_test_result();
+}
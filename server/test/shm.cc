@@ -0,0 +1,112 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "chat_test.hh"
+
+#include "chat_shm.hh"
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+// the shared memory socket behaves like a socket, including once it has
+// been moved from, and carries bytes both ways
+
+int main()
+{
+  boost::asio::io_context io_context;
+
+  {
+    // a moved from socket is closed, not broken
+    chat_shm_socket from {io_context};
+    chat_shm_socket to {std::move(from)};
+
+    check(! from.is_open(), "moved from socket is open");
+    check(from.get_executor() == to.get_executor(), "moved from socket lost its executor");
+
+    boost::system::error_code ec;
+    from.shutdown(chat_shm_socket::shutdown_send, ec);
+    check(ec == boost::asio::error::bad_descriptor, "shutdown of a moved from socket");
+
+    from.close(ec);
+    from = std::move(to);
+    check(! to.is_open(), "move assigned from socket is open");
+  }
+
+  {
+    auto const path = "/tmp/chat_shm_test." + std::to_string(::getpid());
+    ::unlink(path.c_str());
+
+    chat_shm_acceptor acceptor {io_context, chat_shm_protocol::endpoint {path}};
+    chat_shm_socket server {io_context};
+    chat_shm_socket client {io_context};
+
+    std::string const hello {"hello over shared memory"};
+    char server_buf[64] {};
+    char client_buf[64] {};
+    std::size_t echoed {0};
+
+    acceptor.async_accept(
+      [&](boost::system::error_code ec, chat_shm_socket socket)
+      {
+        check(! ec, "accept: " + ec.message());
+        server = std::move(socket);
+
+        boost::asio::async_read(server, boost::asio::buffer(server_buf, hello.size()),
+          [&](boost::system::error_code read_ec, std::size_t length)
+          {
+            check(! read_ec, "server read: " + read_ec.message());
+            boost::asio::async_write(server, boost::asio::buffer(server_buf, length),
+              [](boost::system::error_code write_ec, std::size_t /*length*/)
+              {
+                check(! write_ec, "server write: " + write_ec.message());
+              }
+            );
+          }
+        );
+      }
+    );
+
+    client.async_connect(chat_shm_protocol::endpoint {path},
+      [&](boost::system::error_code ec)
+      {
+        check(! ec, "connect: " + ec.message());
+        check(client.is_open(), "connected socket is closed");
+
+        boost::asio::async_write(client, boost::asio::buffer(hello),
+          [](boost::system::error_code write_ec, std::size_t /*length*/)
+          {
+            check(! write_ec, "client write: " + write_ec.message());
+          }
+        );
+
+        boost::asio::async_read(client, boost::asio::buffer(client_buf, hello.size()),
+          [&](boost::system::error_code read_ec, std::size_t length)
+          {
+            check(! read_ec, "client read: " + read_ec.message());
+            echoed = length;
+
+            boost::system::error_code ignored;
+            client.close(ignored);
+            server.close(ignored);
+          }
+        );
+      }
+    );
+
+    io_context.run_for(std::chrono::seconds(5));
+    ::unlink(path.c_str());
+
+    check(echoed == hello.size() && std::string(client_buf, echoed) == hello,
+      "round trip got: " + std::string(client_buf, echoed));
+  }
+
+  return chat_test_result();
+}
@@ -0,0 +1,152 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "chat_test.hh"
+
+#include "chat_text.hh"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// the vector loops of chat_text.hh give the same answers as the scalar code
+// they skip over, on random text and at every length around the width of a
+// vector, built once for the default target and once with avx2
+
+static bool scalar_utf8_valid(unsigned char const* str, std::size_t length)
+{
+  for (std::size_t i = 0; i < length;)
+  {
+    auto const size = chat_text_detail::utf8_sequence(str + i, length - i);
+    if (! size)
+    {
+      return false;
+    }
+    i += size;
+  }
+
+  return true;
+}
+
+static std::size_t scalar_escape_find(unsigned char const* str, std::size_t length)
+{
+  for (std::size_t i = 0; i < length; ++i)
+  {
+    if (chat_text_detail::needs_escape(str[i]))
+    {
+      return i;
+    }
+  }
+
+  return length;
+}
+
+// mostly ascii with now and then a multi byte character, something to
+// escape, or a byte that breaks the utf-8, so the vector loops stop and
+// restart at every offset
+static std::string random_text(std::mt19937& rng, std::size_t length)
+{
+  static std::string const pieces[] {"\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\"", "\\",
+    "\n", "\x01", "\x1f", " ", "\x7f", "\x80", "\xc3", "\xed\xa0\x80", "\xf4\x90\x80\x80",
+    "\xc0\xaf", "\xff"};
+  std::uniform_int_distribution<int> ascii {0x20, 0x7e};
+  std::uniform_int_distribution<std::size_t> piece {0, sizeof(pieces) / sizeof(pieces[0]) - 1};
+  std::uniform_int_distribution<int> odds {0, 63};
+
+  // how often something other than plain ascii turns up
+  auto const rare = odds(rng);
+
+  std::string text;
+  while (text.size() < length)
+  {
+    if (odds(rng) < rare / 4)
+    {
+      text += pieces[piece(rng)];
+    }
+    else
+    {
+      text += static_cast<char>(ascii(rng));
+    }
+  }
+  text.resize(length);
+
+  return text;
+}
+
+static void compare(std::string const& text, std::string const& what)
+{
+  // copied to every alignment within a vector, with bytes after the end
+  // that would change the answer if they were read
+  for (auto const fill : {'"', '\xff'})
+  {
+    std::vector<char> buf(text.size() + 64, fill);
+    for (std::size_t offset = 0; offset < 32; ++offset)
+    {
+      std::copy(text.begin(), text.end(), buf.begin() + static_cast<std::ptrdiff_t>(offset));
+      auto const data = buf.data() + offset;
+      auto const str = reinterpret_cast<unsigned char const*>(data);
+
+      auto const valid = chat_utf8_valid(data, text.size());
+      check(valid == scalar_utf8_valid(str, text.size()),
+        what + ": utf-8 " + (valid ? "valid" : "invalid") + " at offset " + std::to_string(offset));
+
+      auto const found = chat_escape_find(data, text.size());
+      auto const expected = scalar_escape_find(str, text.size());
+      check(found == expected, what + ": escape at " + std::to_string(found) + " instead of " +
+        std::to_string(expected) + " at offset " + std::to_string(offset));
+
+      // the next offset starts from the fill again
+      std::fill(buf.begin(), buf.end(), fill);
+    }
+  }
+}
+
+int main()
+{
+#if defined(__AVX2__)
+  if (! __builtin_cpu_supports("avx2"))
+  {
+    std::cout << "text: no avx2 on this cpu, skipped\n";
+    return 0;
+  }
+#endif
+
+  std::mt19937 rng {20181017};
+
+  // one byte that is not plain ascii at every position of the lengths
+  // around a vector, first, last, and past the end of the vector loop
+  std::size_t const boundaries[] {1, 15, 16, 17, 31, 32, 33, 47, 48, 63, 64, 65};
+  std::string const specials[] {"\"", "\\", "\x01", "\x1f", "\xc3\xa9", "\xe2\x82\xac",
+    "\xf0\x9f\x98\x80", "\x80", "\xc3", "\xe2\x82", "\xf0\x9f\x98", "\xff"};
+  for (auto const length : boundaries)
+  {
+    std::string const plain(length, 'a');
+    compare(plain, "plain " + std::to_string(length));
+
+    for (auto const& special : specials)
+    {
+      for (std::size_t at = 0; at < length; ++at)
+      {
+        auto text = plain;
+        text.replace(at, std::min(special.size(), length - at), special, 0,
+          std::min(special.size(), length - at));
+        compare(text, "length " + std::to_string(length) + " special at " + std::to_string(at));
+      }
+    }
+  }
+
+  // random text of random lengths, up to a few vectors past a frame
+  std::uniform_int_distribution<std::size_t> lengths {0, 2200};
+  for (std::size_t i = 0; i < 2000; ++i)
+  {
+    auto const length = i < 200 ? i : lengths(rng);
+    compare(random_text(rng, length), "random " + std::to_string(i));
+  }
+
+  return chat_test_result();
+}
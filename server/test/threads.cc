@@ -0,0 +1,149 @@
+// Copyright (c) 2018 Brett Robinson
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "chat_test.hh"
+
+#include "chat_client.hh"
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// room messages sent from several threads at once, on a client driven by
+// several io threads, all go out and all come back once
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: threads_test <server>\n";
+    return 1;
+  }
+
+  enum { senders = 8 };
+  enum { per_sender = 2000 };
+  enum { io_threads = 4 };
+
+  auto const port = chat_test_port(0);
+  chat_test_server server {argv[1], {"--no-flood", std::to_string(static_cast<unsigned>(port))}};
+  if (! server.start(port))
+  {
+    std::cerr << "FAIL: server did not start\n";
+    return 1;
+  }
+
+  boost::asio::io_context io_context;
+  auto work = boost::asio::make_work_guard(io_context);
+
+  chat_client client {io_context};
+  client.ping_interval(std::chrono::milliseconds(0));
+
+  // callbacks run on the client's strand, one at a time
+  std::atomic<bool> logged_in {false};
+  std::atomic<std::size_t> echoed {0};
+  std::unordered_set<std::uint64_t> ids;
+  std::size_t duplicates {0};
+
+  // the server echoes in the order the outbox was written, which has to be
+  // id order for acks to retire the right messages
+  std::uint64_t last_id {0};
+  std::size_t out_of_order {0};
+
+  client.on_srv([&](chat_srv_view const& srv)
+    {
+      if (srv.login)
+      {
+        logged_in = true;
+      }
+    }
+  );
+  client.on_msg([&](chat_msg_view const& msg)
+    {
+      if (msg.user == "alice" && msg.id)
+      {
+        duplicates += ! ids.insert(msg.id).second;
+        out_of_order += msg.id < last_id;
+        last_id = msg.id;
+        ++echoed;
+      }
+    }
+  );
+
+  client.login("alice", "hunter2");
+  client.connect({{boost::asio::ip::address_v4::loopback(), port}});
+
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < io_threads; ++i)
+  {
+    threads.emplace_back([&io_context]() { io_context.run(); });
+  }
+
+  auto const wait = [](std::function<bool()> const& done)
+  {
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+    while (! done() && std::chrono::steady_clock::now() < deadline)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return done();
+  };
+
+  check(wait([&]() { return logged_in.load(); }), "login not confirmed");
+
+  std::vector<std::thread> sending;
+  for (std::size_t t = 0; t < senders; ++t)
+  {
+    sending.emplace_back([&client, t]()
+      {
+        // spread out, so writes and echoes complete while other threads
+        // are part way through queueing
+        for (std::size_t i = 0; i < per_sender; ++i)
+        {
+          client.msg("sender " + std::to_string(t) + " message " + std::to_string(i));
+          if (i % 16 == 0)
+          {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+          }
+        }
+      }
+    );
+  }
+
+  for (auto& thread : sending)
+  {
+    thread.join();
+  }
+
+  bool const all {wait([&]() { return echoed.load() == senders * per_sender; })};
+  check(all, "echoed " + std::to_string(echoed.load()) + " of " +
+    std::to_string(senders * per_sender));
+
+  // the outbox is only read on the strand
+  std::promise<std::size_t> unacked;
+  boost::asio::post(client.executor(), [&]() { unacked.set_value(client.unacked()); });
+  auto const left = unacked.get_future().get();
+  check(left == 0, "unacked after all echoes: " + std::to_string(left));
+
+  client.close();
+  work.reset();
+  server.kill();
+  io_context.stop();
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+
+  check(duplicates == 0, "duplicate echoes: " + std::to_string(duplicates));
+  check(out_of_order == 0, "echoes out of id order: " + std::to_string(out_of_order));
+
+  return chat_test_result();
+}